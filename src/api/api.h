@@ -46,6 +46,7 @@ namespace kiv_os {
 										//OUT : rax je pocet zapsanych bytu
 
 		Read_File,						//IN : dx je handle souboru, rdi je pointer na buffer, kam zapsat, rcx je velikost bufferu v bytech
+										//     bl jsou flags cteni - viz NRead_File konstanty, 0 = blokujici cteni
 										//OUT : rax je pocet prectenych bytu
 		
 		Seek,							//IN : dx je handle souboru, rdi je nova pozice v souboru
@@ -75,6 +76,13 @@ namespace kiv_os {
 
 
 		Create_Pipe,					//IN : rdx je pointer na pole dvou Thandle - prvni zapis a druhy pro cteni z pipy
+										//     rcx je kapacita pipy v bajtech, 0 = vychozi kapacita
+
+		Splice,							//presun dat mezi dvema handly uvnitr jadra bez kopirovani pres proces (soubor, pipa)
+										//IN : dx je handle zdroje, bx je handle cile, rcx je nejvyssi pocet bytu k presunuti
+										//     skonci driv, pokud zdroj vrati mene dat, nez bylo pozadovano (konec souboru, prazdna pipa)
+										//OUT : rax je pocet presunutych bytu, 0 znamena konec zdroje
+										//      pri chybe je cl 1, pokud selhal zapis do cile, jinak 0 (chyba zdroje nebo argumentu)
 
 		
 	};
@@ -97,6 +105,9 @@ namespace kiv_os {
 							//		a u vlakna je to pointer na jeho data
 
 		Wait_For,			//IN : rdx pointer na pole THandle, na ktere se ma cekat, rcx je pocet handlu
+							//     bl jsou udalosti souboru a pip, na ktere se ma cekat - viz NWait_For_File konstanty
+							//     proces a vlakno jsou signalizovany svym ukoncenim, soubor a pipa podle bl
+							//     pri bl = 0 lze cekat jen na procesy a vlakna
 							//funkce se vraci jakmile je signalizovan prvni handle
 							//OUT : rax je index handle, ktery byl signalizovan
 		Read_Exit_Code,		//IN:  dx je handle procesu/thread jehoz exit code se ma cist
@@ -123,6 +134,7 @@ namespace kiv_os {
 		Out_Of_Memory,	
 		Permission_Denied,
 		IO_Error,
+		Would_Block,				//neblokujici operace by musela cekat, napr. na data v prazdne pipe
 
 		Unknown_Error = static_cast<uint16_t>(-1)		//doposud neznama chyba		
 	};
@@ -165,6 +177,17 @@ namespace kiv_os {
 								//není-li fmOpen_Always nastaveno, pak je soubor vždy vytvořen - tj. i přepsán starý soubor
 	};
 
+	//flags cteni ze souboru
+	enum class NRead_File : std::uint8_t {
+		Non_Blocking = 1	//pokud nejsou data k dispozici, cteni z pipy nebo konzole se hned vrati s chybou Would_Block
+	};
+
+	//udalosti souboru a pip pro Wait_For
+	enum class NWait_For_File : std::uint8_t {
+		Readable = 1,		//cteni nebude blokovat - v pipe jsou data nebo je zavreny jeji zapisovaci konec
+		Writable = 2		//zapis nebude blokovat - v pipe je volne misto nebo je zavreny jeji cteci konec
+	};
+
 
 	//Pokud byste potrebovali dalsi cisla sluzeb, chyb, apod. musite je zduvodnit prednasejicimu, aby pripadne rozsiril tento referencni api.h.
 	//Jinak se pozadovane zmeny nebudou propagovat do referencniho api.h, se kterym se bude Vase semestralka prekladat a tudiz nepujde prelozit a nebude akceptovana.
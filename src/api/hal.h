@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
 
 //HAL aka hardware abstraction layer for the kiv_os namespace
 
@@ -87,11 +88,60 @@ namespace kiv_hal {
 										//OUT: Carry pokud je chyba
 										//		ax je NDisk_Status
 
-		Drive_Parameters = 0x48			//ziskej informaci o disku
+		Drive_Parameters = 0x48,		//ziskej informaci o disku
 										//IN:  dl cislo disku (0=A:, 1=druha mechanika, 0x80 prvni disk, 0x81 druhy disk, 0eh cd/dvd, etc.)
 										//		rdi je ukazatel na TDrive_Parameters
 										//OUT: carry pokud je chyba
 										//		ax je NDisk_Status
+
+		Submit_Read_Sectors = 0x50,		//zarad cteni sektoru do fronty disku a hned se vrat
+										//IN: dl je cislo disku
+										//	  rdi je adresa TDisk_Request, ktera musi zustat platna do dokonceni pozadavku
+										//OUT: Carry pokud pozadavek nebyl zarazen
+										//		ax je NDisk_Status
+
+		Submit_Write_Sectors = 0x51,	//zarad zapis sektoru do fronty disku a hned se vrat
+										//IN: dl je cislo disku
+										//	  rdi je adresa TDisk_Request, ktera musi zustat platna do dokonceni pozadavku
+										//OUT: Carry pokud pozadavek nebyl zarazen
+										//		ax je NDisk_Status
+
+		Wait_For_Request = 0x52,		//cekej na dokonceni zarazeneho pozadavku
+										//IN: dl je cislo disku
+										//	  rdi je adresa TDisk_Request
+										//OUT: Carry pokud pozadavek skoncil chybou
+										//		ax je NDisk_Status
+
+		Queue_Statistics = 0x53,		//ziskej statistiky fronty pozadavku disku
+										//IN: dl je cislo disku
+										//	  rdi je ukazatel na TDisk_Queue_Statistics
+										//OUT: carry pokud je chyba
+										//		ax je NDisk_Status
+
+		Drive_Usage = 0x54,				//ziskej velikost disku a velikost pameti, kterou skutecne zabira
+										//IN: dl je cislo disku
+										//	  rdi je ukazatel na TDisk_Usage
+										//OUT: carry pokud je chyba
+										//		ax je NDisk_Status
+
+		Flush = 0x55,					//bariera: pocka na dokonceni vsech drive zarazenych pozadavku a zapise
+										//zapisy drzene disku v pameti trvale do zarizeni; pozdejsi pozadavky
+										//se provedou az po ni
+										//IN: dl je cislo disku
+										//OUT: Carry pokud je chyba
+										//		ax je NDisk_Status
+
+		Read_Sectors_Vectored = 0x56,	//precti sektory z vice useku disku najednou, kazdy usek do vlastniho bufferu
+										//IN: dl je cislo disku
+										//	  rdi je adresa TDisk_Vector_Packet
+										//OUT: Carry pokud je chyba v kteremkoliv useku
+										//		ax je NDisk_Status
+
+		Write_Sectors_Vectored = 0x57	//zapis sektory do vice useku disku najednou, kazdy usek z vlastniho bufferu
+										//IN: dl je cislo disku
+										//	  rdi je adresa TDisk_Vector_Packet
+										//OUT: Carry pokud je chyba v kteremkoliv useku
+										//		ax je NDisk_Status
 	};
 	
 	struct TDisk_Address_Packet {
@@ -100,6 +150,13 @@ namespace kiv_hal {
 		uint64_t lba_index;		//adresa prvniho sektoru na disku
 	};
 
+	//useky pro Read_Sectors_Vectored a Write_Sectors_Vectored
+	//pokud nektery usek lezi mimo disk, neprovede se zadny
+	struct TDisk_Vector_Packet {
+		uint64_t count;						//pocet useku
+		TDisk_Address_Packet* segments;		//pole useku, kazdy s vlastni adresou, poctem sektoru a bufferem
+	};
+
 	struct TDrive_Parameters {
 		uint32_t cylinders, heads, sectors_per_track;
 		uint64_t absolute_number_of_sectors;
@@ -139,4 +196,26 @@ namespace kiv_hal {
 		Drive_Not_Ready = 0xAA
 	};
 
+	//pozadavek pro Submit_Read_Sectors a Submit_Write_Sectors
+	struct TDisk_Request {
+		TDisk_Address_Packet packet;	//sektory k precteni/zapisu
+		std::atomic<bool> completed;	//HAL nastavi na true, az je pozadavek vyrizeny; lze testovat bez blokovani
+		NDisk_Status status;			//vysledek pozadavku, platny az po nastaveni completed
+	};
+
+	struct TDisk_Queue_Statistics {
+		uint64_t requests;				//pocet prijatych pozadavku na cteni/zapis
+		uint64_t issued;				//pocet preneseni dat, ktere disk skutecne provedl
+		uint64_t merged;				//pocet pozadavku pripojenych k prenosu jineho pozadavku se sousednimi sektory
+		uint64_t deadline_expired;		//pocet pozadavku vyrizenych prednostne, protoze cekaly prilis dlouho
+		uint64_t flushes;				//pocet provedenych barier Flush
+		uint64_t max_in_flight;			//nejvyssi pocet prenosu, ktere disk provadel soucasne
+		uint64_t modeled_time_us;		//soucet dob prenosu v mikrosekundach podle modelu zpozdeni disku, 0 bez modelu
+	};
+
+	struct TDisk_Usage {
+		uint64_t logical_size;			//velikost disku v bajtech
+		uint64_t resident_size;			//kolik bajtu disk skutecne zabira, u RAM disku jen alokovane stranky
+	};
+
 };
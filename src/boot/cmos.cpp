@@ -1,14 +1,31 @@
+#include <cstdlib>
+
 #include "cmos.h"
 #include "util.h"
 #include "SimpleIni.h"
 
-#define CMOS_CONFIG_DRIVE_RAM_DISK      "RAM_Disk"
-#define CMOS_CONFIG_DRIVE_RAM_DISK_SIZE "RAM_Disk_Size"
-#define CMOS_CONFIG_DRIVE_READ_ONLY     "Read_Only"
-#define CMOS_CONFIG_DRIVE_DISK_IMAGE    "Disk_Image"
+#define CMOS_CONFIG_DRIVE_RAM_DISK       "RAM_Disk"
+#define CMOS_CONFIG_DRIVE_RAM_DISK_SIZE  "RAM_Disk_Size"
+#define CMOS_CONFIG_DRIVE_READ_ONLY      "Read_Only"
+#define CMOS_CONFIG_DRIVE_DISK_IMAGE     "Disk_Image"
+#define CMOS_CONFIG_DRIVE_MEMORY_MAPPED  "Memory_Mapped"
+#define CMOS_CONFIG_DRIVE_OVERLAY        "Overlay"
+#define CMOS_CONFIG_DRIVE_OVERLAY_FILE   "Overlay_File"
+#define CMOS_CONFIG_DRIVE_OVERLAY_COMMIT "Overlay_Commit"
+#define CMOS_CONFIG_DRIVE_LATENCY_MODEL  "Latency_Model"
+#define CMOS_CONFIG_DRIVE_TRACK_SEEK     "Latency_Track_Seek"
+#define CMOS_CONFIG_DRIVE_FULL_SEEK      "Latency_Full_Seek"
+#define CMOS_CONFIG_DRIVE_RPM            "Latency_RPM"
 
 static CSimpleIniA g_config;
 
+static uint32_t GetUnsignedValue(const std::string & section, const char *key, uint32_t defaultValue)
+{
+	const long value = g_config.GetLongValue(section.c_str(), key, static_cast<long>(defaultValue));
+
+	return (value > 0) ? static_cast<uint32_t>(value) : defaultValue;
+}
+
 bool CMOS::Init()
 {
 	const std::string configFilePath = Util::GetApplicationDirectory() + CMOS_CONFIG_FILENAME;
@@ -30,13 +47,33 @@ CMOS::DriveParameters CMOS::GetDriveParameters(uint8_t driveIndex)
 	
 	if (g_config.GetSection(section.c_str()))
 	{
-		const long minRAMDiskSize = static_cast<long>(result.bytesPerSector);  // alespoň jeden sektor
+		const uint64_t minRAMDiskSize = result.bytesPerSector;  // alespoň jeden sektor
+
+		result.isPresent      = true;
+		result.isRAMDisk      = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_RAM_DISK);
+		result.isReadOnly     = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_READ_ONLY);
+		result.diskImage      = g_config.GetValue(    section.c_str(), CMOS_CONFIG_DRIVE_DISK_IMAGE, "");
+		result.isMemoryMapped = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_MEMORY_MAPPED);
+		result.hasOverlay     = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_OVERLAY);
+		result.overlayFile    = g_config.GetValue(    section.c_str(), CMOS_CONFIG_DRIVE_OVERLAY_FILE, "");
+		result.commitOverlay  = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_OVERLAY_COMMIT);
+
+		result.hasLatencyModel = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_LATENCY_MODEL);
+		result.trackSeekTime   = GetUnsignedValue(section, CMOS_CONFIG_DRIVE_TRACK_SEEK, result.trackSeekTime);
+		result.fullSeekTime    = GetUnsignedValue(section, CMOS_CONFIG_DRIVE_FULL_SEEK, result.fullSeekTime);
+		result.rotationSpeed   = GetUnsignedValue(section, CMOS_CONFIG_DRIVE_RPM, result.rotationSpeed);
+
+		// GetLongValue je ve Windows jen 32bitová, takže by nešlo nastavit RAM disk větší než 2 GiB
+		const char *RAMDiskSize = g_config.GetValue(section.c_str(), CMOS_CONFIG_DRIVE_RAM_DISK_SIZE, nullptr);
+		if (RAMDiskSize)
+		{
+			result.RAMDiskSize = std::strtoull(RAMDiskSize, nullptr, 0);
+		}
 
-		result.isPresent   = true;
-		result.isRAMDisk   = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_RAM_DISK);
-		result.isReadOnly  = g_config.GetBoolValue(section.c_str(), CMOS_CONFIG_DRIVE_READ_ONLY);
-		result.diskImage   = g_config.GetValue(    section.c_str(), CMOS_CONFIG_DRIVE_DISK_IMAGE, "");
-		result.RAMDiskSize = g_config.GetLongValue(section.c_str(), CMOS_CONFIG_DRIVE_RAM_DISK_SIZE, minRAMDiskSize);
+		if (result.RAMDiskSize < minRAMDiskSize)
+		{
+			result.RAMDiskSize = minRAMDiskSize;
+		}
 	}
 
 	return result;
@@ -14,8 +14,18 @@ namespace CMOS
 		bool isReadOnly = true;
 
 		std::string diskImage = "";  // anebo použijeme soubor z disku
+		bool isMemoryMapped = false;  // soubor se namapuje do paměti místo čtení a zápisu přes ReadFile a WriteFile
 
-		size_t RAMDiskSize = 0;
+		bool hasOverlay = false;  // soubor se nemění, zápisy jdou do vrstvy nad ním
+		std::string overlayFile = "";  // vrstva v souboru, pokud je prázdné, tak v paměti
+		bool commitOverlay = false;  // při vypnutí se vrstva zapíše do souboru
+
+		bool hasLatencyModel = false;  // přenosy se zpomalí podle modelu pevného disku
+		uint32_t trackSeekTime = 1000;  // vystavení hlavy na sousední cylindr v mikrosekundách
+		uint32_t fullSeekTime = 15000;  // vystavení hlavy přes celý disk v mikrosekundách
+		uint32_t rotationSpeed = 7200;  // otáčky za minutu
+
+		uint64_t RAMDiskSize = 0;
 		size_t bytesPerSector = 512;
 	};
 
@@ -1,31 +1,43 @@
-#include <cstdio>
+#include <windows.h>
 #include <cstring>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <thread>
 #include <vector>
 
 #include "disk.h"
 #include "cmos.h"
 #include "util.h"
 
-#ifdef _MSC_VER
-#define COMPILER_MSVC
-#endif
-
-static std::FILE *FOpen(const char *fileName, const char *mode)
+/**
+ * @brief Zkopíruje data z nebo do namapovaného souboru.
+ * Pokud se stránku souboru nepodaří načíst nebo zapsat (např. chyba disku nebo síťového disku), Windows vyvolají
+ * výjimku EXCEPTION_IN_PAGE_ERROR, kterou je potřeba zachytit pomocí SEH. Proto je kopírování v samostatné funkci bez
+ * C++ objektů.
+ * @return False, pokud přístup k namapovanému souboru selhal, jinak true.
+ */
+static bool CopyMappedMemory(void *destination, const void *source, size_t length)
 {
-	std::FILE *result = nullptr;
-
-#ifdef COMPILER_MSVC
-	if (fopen_s(&result, fileName, mode) != 0)  // nestandardní nesmysly od Microsoftu
+	__try
+	{
+		std::memcpy(destination, source, length);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
 	{
-		result = nullptr;
+		return false;
 	}
-#else
-	result = std::fopen(fileName, mode);
-#endif
 
-	return result;
+	return true;
 }
 
 class IDiskDrive
@@ -53,7 +65,7 @@ protected:
 	{
 		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
 
-		if (m_bytesPerSector * (pDAP->lba_index + pDAP->count) > m_diskSize)
+		if (!isInRange(pDAP->lba_index, pDAP->count))
 		{
 			// nemůžeme dovolit, výsledkem by byl přístup za velikost disku
 			setStatus(context, kiv_hal::NDisk_Status::Sector_Not_Found);
@@ -70,17 +82,32 @@ public:
 	{
 	}
 
-	void getDriveParameters(kiv_hal::TRegisters & context)
+	virtual ~IDiskDrive() = default;
+
+	size_t getBytesPerSector() const
 	{
-		if (m_diskSize == 0)
-		{
-			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
-			return;
-		}
+		return m_bytesPerSector;
+	}
+
+	uint64_t getDiskSize() const
+	{
+		return m_diskSize;
+	}
+
+	// vrátí true, pokud sektory <lba, lba + count) leží celé na disku
+	bool isInRange(uint64_t lba, uint64_t count) const
+	{
+		return m_bytesPerSector * (lba + count) <= m_diskSize;
+	}
 
+	/**
+	 * @brief Vypočítá geometrii disku podle jeho velikosti.
+	 * @return False, pokud pro velikost disku neexistuje standardní přepočet a geometrie je nastavená na maximum.
+	 */
+	bool computeDriveParameters(kiv_hal::TDrive_Parameters *pParams) const
+	{
 		const uint64_t MB = 1024 * 1024;  // 1 MiB
 
-		kiv_hal::TDrive_Parameters *pParams = reinterpret_cast<kiv_hal::TDrive_Parameters*>(context.rdi.r);
 		bool isAssistedTranslation = true;
 
 		if (m_diskSize < 504 * MB)
@@ -123,48 +150,282 @@ public:
 		pParams->bytes_per_sector = static_cast<uint16_t>(m_bytesPerSector);
 		pParams->absolute_number_of_sectors = m_diskSize / m_bytesPerSector;
 
+		return isAssistedTranslation;
+	}
+
+	void getDriveParameters(kiv_hal::TRegisters & context)
+	{
+		if (m_diskSize == 0)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
+			return;
+		}
+
+		computeDriveParameters(reinterpret_cast<kiv_hal::TDrive_Parameters*>(context.rdi.r));
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+	}
+
+	/**
+	 * @brief Vrátí velikost paměti nebo místa v souboru, které disk skutečně zabírá.
+	 */
+	virtual uint64_t getResidentSize() const
+	{
+		return m_diskSize;
+	}
+
+	void getUsage(kiv_hal::TRegisters & context)
+	{
+		kiv_hal::TDisk_Usage *pUsage = reinterpret_cast<kiv_hal::TDisk_Usage*>(context.rdi.r);
+
+		pUsage->logical_size = m_diskSize;
+		pUsage->resident_size = getResidentSize();
+
 		setStatus(context, kiv_hal::NDisk_Status::No_Error);
 	}
 
+	/**
+	 * @brief Přečte nebo zapíše sektory bez volání přes přerušení.
+	 */
+	kiv_hal::NDisk_Status transfer(bool isWrite, uint64_t lba, uint64_t count, char *buffer)
+	{
+		kiv_hal::TDisk_Address_Packet addressPacket;
+		addressPacket.lba_index = lba;
+		addressPacket.count = count;
+		addressPacket.sectors = buffer;
+
+		kiv_hal::TRegisters context;
+		context.rdi.r = reinterpret_cast<uint64_t>(&addressPacket);
+		context.flags.carry = 0;
+
+		if (isWrite)
+		{
+			writeSectors(context);
+		}
+		else
+		{
+			readSectors(context);
+		}
+
+		if (context.flags.carry)
+		{
+			return static_cast<kiv_hal::NDisk_Status>(context.rax.x);
+		}
+
+		return kiv_hal::NDisk_Status::No_Error;
+	}
+
+	/**
+	 * @brief Vrátí celkovou dobu přenosů v mikrosekundách podle modelu zpoždění disku, 0 pokud disk model nemá.
+	 */
+	virtual uint64_t getModeledTime() const
+	{
+		return 0;
+	}
+
+	/**
+	 * @brief Zjistí, jestli disk zvládne více přenosů různých sektorů současně z různých vláken.
+	 */
+	virtual bool isConcurrent() const
+	{
+		return false;
+	}
+
+	/**
+	 * @brief Zapíše trvale do zařízení všechny dokončené zápisy, které disk zatím drží v paměti.
+	 */
+	virtual kiv_hal::NDisk_Status flush()
+	{
+		return kiv_hal::NDisk_Status::No_Error;
+	}
+
 	virtual void readSectors(kiv_hal::TRegisters & context) = 0;
 	virtual void writeSectors(kiv_hal::TRegisters & context) = 0;
-	
 };
 
+// maximální velikost zapsaných dat, která obraz disku drží v paměti, než je zapíše do souboru
+#define DISK_IMAGE_WRITE_BUFFER_SIZE  (1024 * 1024)
+
+/**
+ * @brief Obraz disku v souboru.
+ * Sektory se čtou a zapisují na zadané pozici v souboru bez sdílené aktuální pozice, takže fronta disku může přenášet
+ * různé sektory z více vláken současně. Menší zápisy se nejdřív ukládají do paměti (write-back) a do souboru se zapíšou
+ * najednou po souvislých úsecích při Flush, po překročení DISK_IMAGE_WRITE_BUFFER_SIZE nebo při zničení disku. Chybu
+ * zápisu sektorů z paměti do souboru hlásí jen Flush, zápis, který zaplnil paměť, se povede i tak.
+ */
 class CDiskImage : public IDiskDrive
 {
 protected:
-	std::FILE *m_pFile;
+	HANDLE m_file;
 	bool m_isReadOnly;
+	std::shared_timed_mutex m_writeBufferLock;  // čtení sdíleně, změny zápisů v paměti výlučně
+	std::map<uint64_t, std::vector<char>> m_writeBuffer;  // zapsané sektory podle LBA, které ještě nejsou v souboru
+	uint64_t m_writeBufferSize;
+	std::atomic<bool> m_isFlushNeeded;  // od posledního Flush se zapisovalo
+
+	/**
+	 * @brief Přečte nebo zapíše data na dané pozici v souboru.
+	 * Pozice se předává ve struktuře OVERLAPPED, synchronní ReadFile a WriteFile ji pak použijí místo aktuální pozice.
+	 * @return False, pokud se nepodařilo přenést všechna data, jinak true.
+	 */
+	bool transfer(uint64_t offset, char *buffer, uint64_t length, bool isWrite)
+	{
+		// délka přenosu pro ReadFile a WriteFile je pouze 32bitová, takže se velké přenosy dělí na části
+		const uint64_t maxChunkSize = 0x40000000;
+
+		while (length > 0)
+		{
+			const DWORD chunkSize = static_cast<DWORD>((length < maxChunkSize) ? length : maxChunkSize);
+
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+			DWORD transferred = 0;
+			BOOL isSuccess;
+
+			if (isWrite)
+			{
+				isSuccess = WriteFile(m_file, buffer, chunkSize, &transferred, &overlapped);
+			}
+			else
+			{
+				isSuccess = ReadFile(m_file, buffer, chunkSize, &transferred, &overlapped);
+			}
+
+			if (!isSuccess || transferred == 0)
+			{
+				return false;
+			}
+
+			offset += transferred;
+			buffer += transferred;
+			length -= transferred;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Zapíše sektory z paměti do souboru. Sousední sektory se zapíšou jedním přenosem.
+	 * Volá se s výlučně zamčeným m_writeBufferLock.
+	 * @return False, pokud zápis selhal, nezapsané sektory pak zůstanou v paměti. Jinak true.
+	 */
+	bool flushWriteBuffer()
+	{
+		std::vector<char> run;
+
+		auto it = m_writeBuffer.begin();
+
+		while (it != m_writeBuffer.end())
+		{
+			const uint64_t lba = it->first;
+
+			run.clear();
+
+			auto last = it;
+			while (last != m_writeBuffer.end() && last->first == lba + run.size() / m_bytesPerSector)
+			{
+				run.insert(run.end(), last->second.begin(), last->second.end());
+				++last;
+			}
+
+			if (!transfer(lba * m_bytesPerSector, run.data(), run.size(), true))
+			{
+				return false;
+			}
+
+			it = m_writeBuffer.erase(it, last);
+			m_writeBufferSize -= run.size();
+		}
+
+		return true;
+	}
 
 public:
 	CDiskImage(const CMOS::DriveParameters & params)
-	: IDiskDrive(params)
+	: IDiskDrive(params),
+	  m_file(INVALID_HANDLE_VALUE),
+	  m_isReadOnly(params.isReadOnly),
+	  m_writeBufferLock(),
+	  m_writeBuffer(),
+	  m_writeBufferSize(0),
+	  m_isFlushNeeded(false)
 	{
-		m_isReadOnly = params.isReadOnly;
-
 		const std::string filePath = Util::GetApplicationDirectory() + params.diskImage;
 
-		m_pFile = FOpen(filePath.c_str(), (m_isReadOnly) ? "rb" : "r+b");
-		if (m_pFile)
+		const DWORD access = (m_isReadOnly) ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+
+		m_file = CreateFileA(filePath.c_str(), access, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file != INVALID_HANDLE_VALUE)
 		{
-			if (std::fseek(m_pFile, 0, SEEK_END) == 0)
+			LARGE_INTEGER fileSize;
+			if (GetFileSizeEx(m_file, &fileSize) && fileSize.QuadPart >= 0)
 			{
-				long pos = std::ftell(m_pFile);
-				if (pos >= 0)
-				{
-					m_diskSize = pos;
-				}
+				m_diskSize = static_cast<uint64_t>(fileSize.QuadPart);
 			}
 		}
 	}
 
+	/**
+	 * @brief Použije již otevřený soubor o dané velikosti. Soubor se zavře při zničení disku.
+	 */
+	CDiskImage(const CMOS::DriveParameters & params, HANDLE file, uint64_t fileSize)
+	: IDiskDrive(params),
+	  m_file(file),
+	  m_isReadOnly(params.isReadOnly),
+	  m_writeBufferLock(),
+	  m_writeBuffer(),
+	  m_writeBufferSize(0),
+	  m_isFlushNeeded(false)
+	{
+		m_diskSize = fileSize;
+	}
+
 	~CDiskImage()
 	{
-		if (m_pFile)
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			flushWriteBuffer();
+			CloseHandle(m_file);
+		}
+	}
+
+	bool isConcurrent() const override
+	{
+		return true;
+	}
+
+	kiv_hal::NDisk_Status flush() override
+	{
+		if (m_file == INVALID_HANDLE_VALUE || m_isReadOnly)
+		{
+			return kiv_hal::NDisk_Status::No_Error;
+		}
+
+		// bez zápisů od posledního Flush není co zapisovat a FlushFileBuffers by jen zbytečně čekal
+		if (!m_isFlushNeeded.exchange(false))
+		{
+			return kiv_hal::NDisk_Status::No_Error;
+		}
+
+		bool isSuccess;
+
+		{
+			std::lock_guard<std::shared_timed_mutex> lock(m_writeBufferLock);
+
+			isSuccess = flushWriteBuffer();
+		}
+
+		// WriteFile pouze předá data systému, na disk se dostanou až po FlushFileBuffers
+		if (!isSuccess || !FlushFileBuffers(m_file))
 		{
-			std::fclose(m_pFile);
+			m_isFlushNeeded = true;
+
+			return kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive;
 		}
+
+		return kiv_hal::NDisk_Status::No_Error;
 	}
 
 	void readSectors(kiv_hal::TRegisters & context) override
@@ -174,27 +435,38 @@ public:
 			return;
 		}
 
-		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
-
-		const long offset = static_cast<long>(m_bytesPerSector * pDAP->lba_index);
-
-		if (!m_pFile || std::fseek(m_pFile, offset, SEEK_SET) != 0)
+		if (m_file == INVALID_HANDLE_VALUE)
 		{
 			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
 			return;
 		}
 
-		const size_t bytesToRead = static_cast<size_t>(pDAP->count * m_bytesPerSector);
-		const size_t bytesRead = std::fread(pDAP->sectors, 1, bytesToRead, m_pFile);
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		const uint64_t offset = pDAP->lba_index * m_bytesPerSector;
+		const uint64_t length = pDAP->count * m_bytesPerSector;
+
+		char *buffer = static_cast<char*>(pDAP->sectors);
+
+		// sektory z paměti se nesmí zapsat do souboru a odebrat mezi čtením souboru a jejich zkopírováním
+		std::shared_lock<std::shared_timed_mutex> lock(m_writeBufferLock);
 
-		if (bytesRead == bytesToRead)
+		if (!transfer(offset, buffer, length, false))
 		{
-			setStatus(context, kiv_hal::NDisk_Status::No_Error);
+			setStatus(context, kiv_hal::NDisk_Status::Address_Mark_Not_Found_Or_Bad_Sector);
+			return;
 		}
-		else
+
+		// sektory v paměti jsou novější než data v souboru
+		auto it = m_writeBuffer.lower_bound(pDAP->lba_index);
+		while (it != m_writeBuffer.end() && it->first < pDAP->lba_index + pDAP->count)
 		{
-			setStatus(context, kiv_hal::NDisk_Status::Address_Mark_Not_Found_Or_Bad_Sector);
+			std::memcpy(buffer + (it->first - pDAP->lba_index) * m_bytesPerSector, it->second.data(), m_bytesPerSector);
+
+			++it;
 		}
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
 	}
 
 	void writeSectors(kiv_hal::TRegisters & context) override
@@ -210,45 +482,181 @@ public:
 			return;
 		}
 
-		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
-
-		const long offset = static_cast<long>(m_bytesPerSector * pDAP->lba_index);
-
-		if (!m_pFile || std::fseek(m_pFile, offset, SEEK_SET) != 0)
+		if (m_file == INVALID_HANDLE_VALUE)
 		{
 			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
 			return;
 		}
 
-		const size_t bytesToWrite = static_cast<size_t>(pDAP->count * m_bytesPerSector);
-		const size_t bytesWritten = std::fwrite(pDAP->sectors, 1, bytesToWrite, m_pFile);
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		const uint64_t offset = pDAP->lba_index * m_bytesPerSector;
+		const uint64_t length = pDAP->count * m_bytesPerSector;
+		char *buffer = static_cast<char*>(pDAP->sectors);
+
+		m_isFlushNeeded = true;
+
+		std::unique_lock<std::shared_timed_mutex> lock(m_writeBufferLock);
 
-		if (bytesWritten == bytesToWrite)
+		if (length >= DISK_IMAGE_WRITE_BUFFER_SIZE)
 		{
+			// velký zápis jde rovnou do souboru a nahradí starší verze sektorů v paměti
+			// ty se odeberou předem, aby je souběžné zapsání paměti do souboru nepřepsalo
+			auto it = m_writeBuffer.lower_bound(pDAP->lba_index);
+			while (it != m_writeBuffer.end() && it->first < pDAP->lba_index + pDAP->count)
+			{
+				m_writeBufferSize -= it->second.size();
+				it = m_writeBuffer.erase(it);
+			}
+
+			lock.unlock();
+
+			if (!transfer(offset, buffer, length, true))
+			{
+				setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+				return;
+			}
+
 			setStatus(context, kiv_hal::NDisk_Status::No_Error);
+			return;
 		}
-		else
+
+		for (uint64_t i = 0; i < pDAP->count; i++)
 		{
-			setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+			std::vector<char> & sector = m_writeBuffer[pDAP->lba_index + i];
+
+			if (sector.empty())
+			{
+				m_writeBufferSize += m_bytesPerSector;
+			}
+
+			sector.assign(buffer + i * m_bytesPerSector, buffer + (i + 1) * m_bytesPerSector);
+		}
+
+		if (m_writeBufferSize > DISK_IMAGE_WRITE_BUFFER_SIZE)
+		{
+			// data tohoto zápisu už jsou v paměti, takže chyba zápisu starších sektorů do souboru se mu nehlásí
+			// nezapsané sektory zůstanou v paměti, zkusí se zapsat znovu a chybu ohlásí až Flush, který je musí zapsat
+			flushWriteBuffer();
 		}
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
 	}
 };
 
-class CRAMDisk : public IDiskDrive
+/**
+ * @brief Obraz disku namapovaný celý do paměti.
+ * Čtení a zápis sektorů je pouze kopírování paměti, o načítání a zápis stránek souboru se stará systém. Změněné stránky
+ * se do souboru zapisují nejpozději při zničení disku. Velikost obrazu není omezená na 2 ani 4 GiB.
+ */
+class CMappedDiskImage : public IDiskDrive
 {
 protected:
-	std::vector<char> m_buffer;
+	HANDLE m_file;
+	HANDLE m_mapping;
+	char *m_pView;
+	bool m_isReadOnly;
+	std::atomic<bool> m_isFlushNeeded;  // od posledního Flush se zapisovalo
 
 public:
-	CRAMDisk(const CMOS::DriveParameters & params)
-	: IDiskDrive(params)
+	CMappedDiskImage(const CMOS::DriveParameters & params)
+	: IDiskDrive(params),
+	  m_file(INVALID_HANDLE_VALUE),
+	  m_mapping(NULL),
+	  m_pView(nullptr),
+	  m_isReadOnly(params.isReadOnly),
+	  m_isFlushNeeded(false)
 	{
-		m_diskSize = params.RAMDiskSize;
-		m_buffer.resize(static_cast<size_t>(m_diskSize));
+		const std::string filePath = Util::GetApplicationDirectory() + params.diskImage;
+
+		const DWORD access = (m_isReadOnly) ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+
+		m_file = CreateFileA(filePath.c_str(), access, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart <= 0)
+		{
+			// prázdný soubor nelze namapovat
+			return;
+		}
+
+		const DWORD protection = (m_isReadOnly) ? PAGE_READONLY : PAGE_READWRITE;
+
+		m_mapping = CreateFileMappingA(m_file, NULL, protection, 0, 0, NULL);
+		if (!m_mapping)
+		{
+			return;
+		}
+
+		const DWORD viewAccess = (m_isReadOnly) ? FILE_MAP_READ : FILE_MAP_WRITE;
+
+		m_pView = static_cast<char*>(MapViewOfFile(m_mapping, viewAccess, 0, 0, 0));
+		if (!m_pView)
+		{
+			return;
+		}
+
+		m_diskSize = static_cast<uint64_t>(fileSize.QuadPart);
+	}
+
+	~CMappedDiskImage()
+	{
+		if (m_pView)
+		{
+			flush();
+			UnmapViewOfFile(m_pView);
+		}
+
+		if (m_mapping)
+		{
+			CloseHandle(m_mapping);
+		}
+
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_file);
+		}
+	}
+
+	bool isConcurrent() const override
+	{
+		// různé sektory jsou různá místa v paměti
+		return true;
+	}
+
+	/**
+	 * @brief Zapíše změněné stránky do souboru obrazu.
+	 */
+	kiv_hal::NDisk_Status flush() override
+	{
+		if (!m_pView || m_isReadOnly || !m_isFlushNeeded.exchange(false))
+		{
+			return kiv_hal::NDisk_Status::No_Error;
+		}
+
+		// FlushViewOfFile pouze předá stránky systému, na disk se dostanou až po FlushFileBuffers
+		if (!FlushViewOfFile(m_pView, 0) || !FlushFileBuffers(m_file))
+		{
+			m_isFlushNeeded = true;
+
+			return kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive;
+		}
+
+		return kiv_hal::NDisk_Status::No_Error;
 	}
 
 	void readSectors(kiv_hal::TRegisters & context) override
 	{
+		if (!m_pView)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
+			return;
+		}
+
 		if (!checkDAP(context))
 		{
 			return;
@@ -256,16 +664,33 @@ public:
 
 		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
 
-		const size_t pos = static_cast<size_t>(pDAP->lba_index * m_bytesPerSector);
+		const uint64_t pos = pDAP->lba_index * m_bytesPerSector;
 		const size_t length = static_cast<size_t>(pDAP->count * m_bytesPerSector);
 
-		std::memcpy(pDAP->sectors, m_buffer.data() + pos, length);
-
-		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+		if (CopyMappedMemory(pDAP->sectors, m_pView + pos, length))
+		{
+			setStatus(context, kiv_hal::NDisk_Status::No_Error);
+		}
+		else
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Address_Mark_Not_Found_Or_Bad_Sector);
+		}
 	}
 
 	void writeSectors(kiv_hal::TRegisters & context) override
 	{
+		if (m_isReadOnly)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+			return;
+		}
+
+		if (!m_pView)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
+			return;
+		}
+
 		if (!checkDAP(context))
 		{
 			return;
@@ -273,55 +698,1233 @@ public:
 
 		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
 
-		const size_t pos = static_cast<size_t>(pDAP->lba_index * m_bytesPerSector);
+		const uint64_t pos = pDAP->lba_index * m_bytesPerSector;
 		const size_t length = static_cast<size_t>(pDAP->count * m_bytesPerSector);
 
-		std::memcpy(m_buffer.data() + pos, pDAP->sectors, length);
+		m_isFlushNeeded = true;
 
-		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+		if (CopyMappedMemory(m_pView + pos, pDAP->sectors, length))
+		{
+			setStatus(context, kiv_hal::NDisk_Status::No_Error);
+		}
+		else
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+		}
 	}
 };
 
-static std::array<std::unique_ptr<IDiskDrive>, 256> g_diskDrives;
+// velikost stránky RAM disku, stránky se alokují až při prvním zápisu
+#define RAM_DISK_PAGE_SIZE  (64 * 1024)
 
-void __stdcall Disk::InterruptHandler(kiv_hal::TRegisters & context)
+/**
+ * @brief RAM disk s paměťí alokovanou po stránkách až při prvním zápisu.
+ * Čtení nikdy nezapsaných stránek vrací nuly. Zápis samých nul do nealokované stránky ji nealokuje.
+ * Čtení a zápisy volá pouze vlákno fronty disku, souběžně se čte jen velikost alokované paměti.
+ */
+class CRAMDisk : public IDiskDrive
 {
-	const uint8_t diskIndex = context.rdx.l;
+protected:
+	std::vector<std::unique_ptr<char[]>> m_pages;
+	std::atomic<uint64_t> m_residentSize;
+
+	static bool IsZero(const char *data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			if (data[i] != 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+public:
+	CRAMDisk(const CMOS::DriveParameters & params)
+	: IDiskDrive(params),
+	  m_pages(),
+	  m_residentSize(0)
+	{
+		m_diskSize = params.RAMDiskSize;
+
+		const uint64_t pageCount = (m_diskSize + RAM_DISK_PAGE_SIZE - 1) / RAM_DISK_PAGE_SIZE;
+
+		m_pages.resize(static_cast<size_t>(pageCount));
+	}
+
+	uint64_t getResidentSize() const override
+	{
+		return m_residentSize.load(std::memory_order_relaxed);
+	}
+
+	void readSectors(kiv_hal::TRegisters & context) override
+	{
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		uint64_t pos = pDAP->lba_index * m_bytesPerSector;
+		uint64_t length = pDAP->count * m_bytesPerSector;
+		char *buffer = static_cast<char*>(pDAP->sectors);
+
+		while (length > 0)
+		{
+			const size_t pageOffset = static_cast<size_t>(pos % RAM_DISK_PAGE_SIZE);
+			const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(RAM_DISK_PAGE_SIZE - pageOffset, length));
+
+			const std::unique_ptr<char[]> & page = m_pages[static_cast<size_t>(pos / RAM_DISK_PAGE_SIZE)];
+
+			if (page)
+			{
+				std::memcpy(buffer, page.get() + pageOffset, chunkSize);
+			}
+			else
+			{
+				std::memset(buffer, 0, chunkSize);
+			}
+
+			pos += chunkSize;
+			length -= chunkSize;
+			buffer += chunkSize;
+		}
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+	}
+
+	void writeSectors(kiv_hal::TRegisters & context) override
+	{
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		uint64_t pos = pDAP->lba_index * m_bytesPerSector;
+		uint64_t length = pDAP->count * m_bytesPerSector;
+		const char *buffer = static_cast<const char*>(pDAP->sectors);
+
+		while (length > 0)
+		{
+			const size_t pageOffset = static_cast<size_t>(pos % RAM_DISK_PAGE_SIZE);
+			const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(RAM_DISK_PAGE_SIZE - pageOffset, length));
+
+			std::unique_ptr<char[]> & page = m_pages[static_cast<size_t>(pos / RAM_DISK_PAGE_SIZE)];
+
+			if (!page && !IsZero(buffer, chunkSize))
+			{
+				page.reset(new (std::nothrow) char[RAM_DISK_PAGE_SIZE]());
+				if (!page)
+				{
+					// v počítači už není volná paměť
+					setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+					return;
+				}
+
+				m_residentSize.fetch_add(RAM_DISK_PAGE_SIZE, std::memory_order_relaxed);
+			}
+
+			if (page)
+			{
+				std::memcpy(page.get() + pageOffset, buffer, chunkSize);
+			}
+
+			pos += chunkSize;
+			length -= chunkSize;
+			buffer += chunkSize;
+		}
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+	}
+};
+
+// maximální počet sektorů přenesených najednou při zápisu vrstvy do obrazu
+#define OVERLAY_COMMIT_MAX_SECTORS  2048
+
+/**
+ * @brief Zapisovatelná vrstva nad obrazem disku, který zůstává beze změny (copy-on-write).
+ * Zapsané sektory se ukládají do vrstvy a ostatní se čtou z obrazu. Vrstva je buď řídký RAM disk, nebo řídký soubor,
+ * který se při každém spuštění vytvoří znovu prázdný a po vypnutí se smaže. Čistý start tedy nezávisí na velikosti
+ * obrazu. Pokud je to v konfiguraci povolené, zapíšou se změny z vrstvy při zničení disku zpět do obrazu.
+ * Čtení a zápisy volá pouze vlákno fronty disku.
+ */
+class COverlayDisk : public IDiskDrive
+{
+protected:
+	std::unique_ptr<IDiskDrive> m_base;
+	std::unique_ptr<IDiskDrive> m_overlay;
+	std::vector<bool> m_isOverlaid;  // sektory, které jsou ve vrstvě
+	uint64_t m_overlaidSectorCount;
+	bool m_isReadOnly;
+	bool m_isCommitOnClose;
+
+	static std::unique_ptr<IDiskDrive> CreateBase(const CMOS::DriveParameters & params)
+	{
+		CMOS::DriveParameters baseParams = params;
+
+		// do obrazu se zapisuje jen při zápisu vrstvy zpět
+		baseParams.isReadOnly = params.isReadOnly || !params.commitOverlay;
+
+		if (params.isMemoryMapped)
+		{
+			return std::make_unique<CMappedDiskImage>(baseParams);
+		}
+		else
+		{
+			return std::make_unique<CDiskImage>(baseParams);
+		}
+	}
+
+	static std::unique_ptr<IDiskDrive> CreateOverlay(const CMOS::DriveParameters & params, uint64_t size)
+	{
+		CMOS::DriveParameters overlayParams = params;
+		overlayParams.isReadOnly = false;
+
+		if (params.overlayFile.empty())
+		{
+			overlayParams.RAMDiskSize = size;
+
+			return std::make_unique<CRAMDisk>(overlayParams);
+		}
+
+		const std::string filePath = Util::GetApplicationDirectory() + params.overlayFile;
+
+		HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return nullptr;
+		}
+
+		// řídký soubor zabírá místo jen pro zapsané oblasti
+		// pokud ho souborový systém nepodporuje, vrstva bude fungovat i s obyčejným souborem
+		DWORD bytesReturned = 0;
+		DeviceIoControl(file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL);
+
+		LARGE_INTEGER fileSize;
+		fileSize.QuadPart = static_cast<LONGLONG>(size);
+
+		if (!SetFilePointerEx(file, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		return std::make_unique<CDiskImage>(overlayParams, file, size);
+	}
+
+public:
+	COverlayDisk(const CMOS::DriveParameters & params)
+	: IDiskDrive(params),
+	  m_base(CreateBase(params)),
+	  m_overlay(),
+	  m_isOverlaid(),
+	  m_overlaidSectorCount(0),
+	  m_isReadOnly(params.isReadOnly),
+	  m_isCommitOnClose(params.commitOverlay && !params.isReadOnly)
+	{
+		const uint64_t baseSize = m_base->getDiskSize();
+		if (baseSize == 0)
+		{
+			// obraz nelze otevřít
+			return;
+		}
+
+		m_overlay = CreateOverlay(params, baseSize);
+		if (!m_overlay)
+		{
+			return;
+		}
+
+		m_isOverlaid.resize(static_cast<size_t>(baseSize / m_bytesPerSector), false);
+
+		m_diskSize = baseSize;
+	}
+
+	~COverlayDisk()
+	{
+		if (m_isCommitOnClose)
+		{
+			commit();
+		}
+	}
+
+	/**
+	 * @brief Zapíše všechny sektory z vrstvy do obrazu.
+	 * @return False, pokud se některé sektory nepodařilo přenést, jinak true.
+	 */
+	bool commit()
+	{
+		if (!m_overlay)
+		{
+			return false;
+		}
+
+		std::vector<char> buffer;
+		bool isSuccess = true;
+
+		uint64_t lba = 0;
+
+		while (lba < m_isOverlaid.size())
+		{
+			if (!m_isOverlaid[static_cast<size_t>(lba)])
+			{
+				lba++;
+				continue;
+			}
+
+			uint64_t count = 1;
+			while (lba + count < m_isOverlaid.size() && count < OVERLAY_COMMIT_MAX_SECTORS
+			    && m_isOverlaid[static_cast<size_t>(lba + count)])
+			{
+				count++;
+			}
+
+			buffer.resize(static_cast<size_t>(count * m_bytesPerSector));
+
+			if (m_overlay->transfer(false, lba, count, buffer.data()) != kiv_hal::NDisk_Status::No_Error
+			 || m_base->transfer(true, lba, count, buffer.data()) != kiv_hal::NDisk_Status::No_Error)
+			{
+				isSuccess = false;
+			}
+
+			lba += count;
+		}
+
+		return m_base->flush() == kiv_hal::NDisk_Status::No_Error && isSuccess;
+	}
+
+	kiv_hal::NDisk_Status flush() override
+	{
+		// vrstva po vypnutí zanikne a obraz se mění jen při commit, takže není co trvale zapisovat
+		return kiv_hal::NDisk_Status::No_Error;
+	}
+
+	uint64_t getResidentSize() const override
+	{
+		// obraz se nepočítá, ten existuje i bez vrstvy
+		return m_overlaidSectorCount * m_bytesPerSector;
+	}
+
+	void readSectors(kiv_hal::TRegisters & context) override
+	{
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		if (!m_overlay)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		uint64_t lba = pDAP->lba_index;
+		uint64_t remaining = pDAP->count;
+		char *buffer = static_cast<char*>(pDAP->sectors);
+
+		// souvislé úseky sektorů se stejným původem se čtou najednou
+		while (remaining > 0)
+		{
+			const bool isOverlaid = m_isOverlaid[static_cast<size_t>(lba)];
+
+			uint64_t count = 1;
+			while (count < remaining && m_isOverlaid[static_cast<size_t>(lba + count)] == isOverlaid)
+			{
+				count++;
+			}
+
+			IDiskDrive & drive = (isOverlaid) ? *m_overlay : *m_base;
+
+			const kiv_hal::NDisk_Status status = drive.transfer(false, lba, count, buffer);
+			if (status != kiv_hal::NDisk_Status::No_Error)
+			{
+				setStatus(context, status);
+				return;
+			}
+
+			lba += count;
+			remaining -= count;
+			buffer += count * m_bytesPerSector;
+		}
+
+		setStatus(context, kiv_hal::NDisk_Status::No_Error);
+	}
+
+	void writeSectors(kiv_hal::TRegisters & context) override
+	{
+		if (m_isReadOnly)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive);
+			return;
+		}
+
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		if (!m_overlay)
+		{
+			setStatus(context, kiv_hal::NDisk_Status::Drive_Not_Ready);
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		const kiv_hal::NDisk_Status status = m_overlay->transfer(true, pDAP->lba_index, pDAP->count,
+		                                                         static_cast<char*>(pDAP->sectors));
+		if (status == kiv_hal::NDisk_Status::No_Error)
+		{
+			for (uint64_t i = 0; i < pDAP->count; i++)
+			{
+				std::vector<bool>::reference isOverlaid = m_isOverlaid[static_cast<size_t>(pDAP->lba_index + i)];
+
+				if (!isOverlaid)
+				{
+					isOverlaid = true;
+					m_overlaidSectorCount++;
+				}
+			}
+		}
+
+		setStatus(context, status);
+	}
+};
+
+/**
+ * @brief Disk zpomalený podle modelu pevného disku.
+ * Každý přenos trvá tak dlouho, jako by disk s geometrií z getDriveParameters musel vystavit hlavu na cylindr prvního
+ * sektoru, počkat, až se pod ni sektor otočí, a pak přečíst nebo zapsat všechny sektory. Doba vystavení roste
+ * s odmocninou vzdálenosti cylindrů. Natočení plotny se počítá z doby všech předchozích přenosů, ne ze skutečného času,
+ * takže stejná posloupnost požadavků má vždy stejnou celkovou dobu (getModeledTime). Disk nemá souběžné přenosy.
+ */
+class CLatencyDisk : public IDiskDrive
+{
+protected:
+	std::unique_ptr<IDiskDrive> m_drive;
+	uint64_t m_sectorsPerTrack;
+	uint64_t m_sectorsPerCylinder;
+	uint64_t m_cylinderCount;
+	uint64_t m_trackSeekTime;   // v nanosekundách
+	uint64_t m_fullSeekTime;    // v nanosekundách
+	uint64_t m_rotationTime;    // v nanosekundách
+	uint64_t m_headCylinder;    // cylindr, nad kterým je hlava po posledním přenosu
+	uint64_t m_clock;           // součet dob všech přenosů v nanosekundách
+	std::atomic<uint64_t> m_modeledTime;
+	std::chrono::steady_clock::time_point m_readyTime;  // kdy skončí poslední přenos ve skutečném čase
+
+	uint64_t getSeekTime(uint64_t cylinder) const
+	{
+		const uint64_t distance = (cylinder > m_headCylinder) ? cylinder - m_headCylinder : m_headCylinder - cylinder;
+
+		if (distance == 0)
+		{
+			return 0;
+		}
+
+		const double ratio = std::sqrt(static_cast<double>(distance - 1) / static_cast<double>(m_cylinderCount));
+
+		return m_trackSeekTime + static_cast<uint64_t>((m_fullSeekTime - m_trackSeekTime) * ratio);
+	}
+
+	/**
+	 * @brief Spočítá dobu přenosu podle modelu, posune stav disku a počká odpovídající dobu.
+	 */
+	void delay(uint64_t lba, uint64_t count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		const uint64_t cylinder = lba / m_sectorsPerCylinder;
+		const uint64_t seekTime = getSeekTime(cylinder);
+
+		// natočení plotny po vystavení hlavy a úhel, na kterém začíná první sektor
+		const uint64_t angle = (m_clock + seekTime) % m_rotationTime;
+		const uint64_t sectorAngle = (lba % m_sectorsPerTrack) * m_rotationTime / m_sectorsPerTrack;
+
+		const uint64_t rotationalTime = (sectorAngle + m_rotationTime - angle) % m_rotationTime;
+		const uint64_t transferTime = count * m_rotationTime / m_sectorsPerTrack;
+
+		const uint64_t totalTime = seekTime + rotationalTime + transferTime;
+
+		m_clock += totalTime;
+		m_headCylinder = (lba + count - 1) / m_sectorsPerCylinder;
+		m_modeledTime.store(m_clock / 1000, std::memory_order_relaxed);
+
+		// čeká se do konce přenosu počítaného od konce předchozího, takže nepřesné uspání vlákna se neskládá
+		const auto now = std::chrono::steady_clock::now();
+
+		if (m_readyTime < now)
+		{
+			m_readyTime = now;
+		}
+
+		m_readyTime += std::chrono::nanoseconds(totalTime);
+
+		std::this_thread::sleep_until(m_readyTime);
+	}
+
+public:
+	CLatencyDisk(const CMOS::DriveParameters & params, std::unique_ptr<IDiskDrive> drive)
+	: IDiskDrive(params),
+	  m_drive(std::move(drive)),
+	  m_sectorsPerTrack(63),
+	  m_sectorsPerCylinder(63 * 255),
+	  m_cylinderCount(1),
+	  m_trackSeekTime(static_cast<uint64_t>(params.trackSeekTime) * 1000),
+	  m_fullSeekTime(static_cast<uint64_t>(params.fullSeekTime) * 1000),
+	  m_rotationTime(60000000000ULL / ((params.rotationSpeed > 0) ? params.rotationSpeed : 1)),
+	  m_headCylinder(0),
+	  m_clock(0),
+	  m_modeledTime(0),
+	  m_readyTime()
+	{
+		m_diskSize = m_drive->getDiskSize();
+
+		if (m_fullSeekTime < m_trackSeekTime)
+		{
+			m_fullSeekTime = m_trackSeekTime;
+		}
+
+		kiv_hal::TDrive_Parameters driveParams;
+
+		// velké disky nemají standardní geometrii, zůstane pro ně největší běžná (255 hlav, 63 sektorů na stopu)
+		if (computeDriveParameters(&driveParams))
+		{
+			m_sectorsPerTrack = driveParams.sectors_per_track;
+			m_sectorsPerCylinder = static_cast<uint64_t>(driveParams.sectors_per_track) * driveParams.heads;
+		}
+
+		m_cylinderCount = std::max<uint64_t>(driveParams.absolute_number_of_sectors / m_sectorsPerCylinder, 1);
+	}
+
+	uint64_t getResidentSize() const override
+	{
+		return m_drive->getResidentSize();
+	}
+
+	uint64_t getModeledTime() const override
+	{
+		return m_modeledTime.load(std::memory_order_relaxed);
+	}
+
+	kiv_hal::NDisk_Status flush() override
+	{
+		return m_drive->flush();
+	}
+
+	void readSectors(kiv_hal::TRegisters & context) override
+	{
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		delay(pDAP->lba_index, pDAP->count);
+
+		setStatus(context, m_drive->transfer(false, pDAP->lba_index, pDAP->count, static_cast<char*>(pDAP->sectors)));
+	}
+
+	void writeSectors(kiv_hal::TRegisters & context) override
+	{
+		if (!checkDAP(context))
+		{
+			return;
+		}
+
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		delay(pDAP->lba_index, pDAP->count);
+
+		setStatus(context, m_drive->transfer(true, pDAP->lba_index, pDAP->count, static_cast<char*>(pDAP->sectors)));
+	}
+};
+
+// požadavek, který čeká déle, se vyřídí přednostně bez ohledu na pozici na disku
+#define DISK_QUEUE_DEADLINE_MS  50
+
+// maximální počet sektorů jednoho sloučeného přenosu
+#define DISK_QUEUE_MAX_MERGED_SECTORS  2048
+
+// počet vláken fronty disku, který zvládne více přenosů současně
+#define DISK_QUEUE_THREAD_COUNT  4
+
+/**
+ * @brief Fronta požadavků na čtení a zápis sektorů jednoho disku.
+ * Požadavky vyřizují vlákna fronty. Vybírají je podle LBA ve směru od posledního přeneseného sektoru (výtah) a
+ * navazující požadavky stejného směru spojí do jednoho přenosu. Požadavek, který čeká déle než DISK_QUEUE_DEADLINE_MS,
+ * dostane přednost. Požadavek nikdy nepředběhne dřívější ani právě probíhající požadavek na stejné sektory, pokud je
+ * jeden z nich zápis. Flush je bariéra: provede se až po všech dřívějších požadavcích a žádný pozdější požadavek ji
+ * nepředběhne.
+ *
+ * Pokud disk zvládne více přenosů současně (IDiskDrive::isConcurrent), má fronta DISK_QUEUE_THREAD_COUNT vláken a
+ * nezávislé přenosy probíhají souběžně, jinak má jen jedno vlákno.
+ */
+class CDiskQueue
+{
+	struct Request
+	{
+		bool isWrite = false;
+		bool isFlush = false;
+		uint64_t lba = 0;
+		uint64_t count = 0;
+		char *buffer = nullptr;
+		std::chrono::steady_clock::time_point submitTime;
+		kiv_hal::TDisk_Request *pAsyncRequest = nullptr;  // nullptr u synchronních požadavků
+		bool isDone = false;
+		kiv_hal::NDisk_Status status = kiv_hal::NDisk_Status::No_Error;
+
+		uint64_t end() const
+		{
+			return lba + count;
+		}
+	};
+
+	using RequestPtr = std::shared_ptr<Request>;
+
+	std::unique_ptr<IDiskDrive> m_drive;
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;      // přibyl požadavek nebo skončil přenos, který mohl jiné blokovat
+	std::condition_variable m_requestCompleted;
+	std::list<RequestPtr> m_pending;  // v pořadí zařazení
+	std::list<RequestPtr> m_active;   // požadavky právě přenášené některým vláknem
+	uint64_t m_activeTransfers;
+	uint64_t m_headPosition;          // sektor za koncem posledního přenosu
+	bool m_isStopping;
+	kiv_hal::TDisk_Queue_Statistics m_stats;
+	std::vector<std::thread> m_threads;
+
+	static void SetStatus(kiv_hal::TRegisters & context, kiv_hal::NDisk_Status status)
+	{
+		if (status == kiv_hal::NDisk_Status::No_Error)
+		{
+			context.flags.carry = 0;
+		}
+		else
+		{
+			context.flags.carry = 1;
+			context.rax.x = static_cast<uint16_t>(status);
+		}
+	}
+
+	/**
+	 * @brief Zjistí, jestli musí požadavek request počkat na dokončení požadavku earlier.
+	 */
+	static bool IsConflicting(const Request & earlier, const Request & request)
+	{
+		if (earlier.isFlush || request.isFlush)
+		{
+			return true;
+		}
+
+		const bool isOverlapping = earlier.lba < request.end() && request.lba < earlier.end();
+
+		return isOverlapping && (earlier.isWrite || request.isWrite);
+	}
+
+	/**
+	 * @brief Zjistí, jestli požadavek nemusí čekat na některý probíhající nebo dřívější požadavek ve frontě.
+	 */
+	bool canBeServed(std::list<RequestPtr>::const_iterator it) const
+	{
+		const Request & request = **it;
+
+		for (const RequestPtr & active : m_active)
+		{
+			if (IsConflicting(*active, request))
+			{
+				return false;
+			}
+		}
+
+		for (auto earlierIt = m_pending.begin(); earlierIt != it; ++earlierIt)
+		{
+			if (IsConflicting(**earlierIt, request))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Vybere další přenos a odebere jeho požadavky z fronty.
+	 * @return False, pokud ve frontě není žádný požadavek, který by mohl začít hned, jinak true.
+	 */
+	bool selectBatch(std::vector<RequestPtr> & batch)
+	{
+		if (m_pending.empty())
+		{
+			return false;
+		}
+
+		auto selectedIt = m_pending.begin();
+
+		const auto waitTime = std::chrono::steady_clock::now() - (*selectedIt)->submitTime;
+
+		if (waitTime >= std::chrono::milliseconds(DISK_QUEUE_DEADLINE_MS) && canBeServed(selectedIt))
+		{
+			// nejstarší požadavek nemůže čekat na nic jiného
+			m_stats.deadline_expired++;
+		}
+		else
+		{
+			// nejbližší požadavek za posledním přenosem, případně první od začátku disku
+			auto nextIt = m_pending.end();
+			auto firstIt = m_pending.end();
+
+			for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+			{
+				if (!canBeServed(it))
+				{
+					continue;
+				}
+
+				const uint64_t lba = (*it)->lba;
+
+				if (lba >= m_headPosition && (nextIt == m_pending.end() || lba < (*nextIt)->lba))
+				{
+					nextIt = it;
+				}
+
+				if (firstIt == m_pending.end() || lba < (*firstIt)->lba)
+				{
+					firstIt = it;
+				}
+			}
+
+			selectedIt = (nextIt != m_pending.end()) ? nextIt : firstIt;
+
+			if (selectedIt == m_pending.end())
+			{
+				// všechny požadavky čekají na probíhající přenosy
+				return false;
+			}
+		}
+
+		batch.push_back(*selectedIt);
+		m_pending.erase(selectedIt);
+
+		if (batch.front()->isFlush)
+		{
+			return true;
+		}
+
+		// připojí navazující požadavky stejného směru
+		const bool isWrite = batch.front()->isWrite;
+		uint64_t end = batch.front()->end();
+		uint64_t count = batch.front()->count;
+
+		bool isMerged = true;
+
+		while (isMerged)
+		{
+			isMerged = false;
+
+			for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+			{
+				const Request & request = **it;
+
+				if (request.isWrite != isWrite || request.lba != end
+				 || count + request.count > DISK_QUEUE_MAX_MERGED_SECTORS || !canBeServed(it))
+				{
+					continue;
+				}
+
+				end = request.end();
+				count += request.count;
+
+				batch.push_back(*it);
+				m_pending.erase(it);
+
+				m_stats.merged++;
+
+				isMerged = true;
+				break;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Provede přenos všech požadavků najednou. Volá se bez zámku fronty.
+	 */
+	kiv_hal::NDisk_Status transfer(const std::vector<RequestPtr> & batch)
+	{
+		const Request & first = *batch.front();
+
+		if (first.isFlush)
+		{
+			return m_drive->flush();
+		}
+
+		const size_t bytesPerSector = m_drive->getBytesPerSector();
+
+		uint64_t count = 0;
+		for (const RequestPtr & request : batch)
+		{
+			count += request->count;
+		}
+
+		// jeden požadavek se přenese přímo do jeho bufferu, sloučené přes společný buffer
+		std::vector<char> buffer;
+		char *data = first.buffer;
+
+		if (batch.size() > 1)
+		{
+			buffer.resize(static_cast<size_t>(count * bytesPerSector));
+			data = buffer.data();
+
+			if (first.isWrite)
+			{
+				size_t offset = 0;
+
+				for (const RequestPtr & request : batch)
+				{
+					const size_t length = static_cast<size_t>(request->count * bytesPerSector);
 
-	if (!g_diskDrives[diskIndex])
+					std::memcpy(data + offset, request->buffer, length);
+					offset += length;
+				}
+			}
+		}
+
+		const kiv_hal::NDisk_Status status = m_drive->transfer(first.isWrite, first.lba, count, data);
+		if (status != kiv_hal::NDisk_Status::No_Error)
+		{
+			return status;
+		}
+
+		if (batch.size() > 1 && !first.isWrite)
+		{
+			size_t offset = 0;
+
+			for (const RequestPtr & request : batch)
+			{
+				const size_t length = static_cast<size_t>(request->count * bytesPerSector);
+
+				std::memcpy(request->buffer, data + offset, length);
+				offset += length;
+			}
+		}
+
+		return kiv_hal::NDisk_Status::No_Error;
+	}
+
+	void run()
 	{
-		const CMOS::DriveParameters params = CMOS::GetDriveParameters(diskIndex);
+		std::unique_lock<std::mutex> lock(m_mutex);
 
-		if (params.isPresent)
+		for (;;)
 		{
-			if (params.isRAMDisk)
+			std::vector<RequestPtr> batch;
+
+			while (!selectBatch(batch))
+			{
+				if (m_isStopping && m_pending.empty())
+				{
+					// fronta se před ukončením vždy vyprázdní
+					return;
+				}
+
+				m_queueChanged.wait(lock);
+			}
+
+			if (batch.front()->isFlush)
 			{
-				g_diskDrives[diskIndex] = std::make_unique<CRAMDisk>(params);
+				m_stats.flushes++;
 			}
 			else
 			{
-				g_diskDrives[diskIndex] = std::make_unique<CDiskImage>(params);
+				m_stats.issued++;
+				m_headPosition = batch.back()->end();
+			}
+
+			m_active.insert(m_active.end(), batch.begin(), batch.end());
+			m_activeTransfers++;
+
+			if (m_activeTransfers > m_stats.max_in_flight)
+			{
+				m_stats.max_in_flight = m_activeTransfers;
+			}
+
+			lock.unlock();
+
+			const kiv_hal::NDisk_Status status = transfer(batch);
+
+			lock.lock();
+
+			m_activeTransfers--;
+
+			for (const RequestPtr & request : batch)
+			{
+				m_active.remove(request);
+
+				request->status = status;
+				request->isDone = true;
+
+				if (request->pAsyncRequest)
+				{
+					request->pAsyncRequest->status = status;
+					request->pAsyncRequest->completed.store(true, std::memory_order_release);
+				}
+			}
+
+			m_requestCompleted.notify_all();
+
+			// dokončený přenos mohl uvolnit požadavky, na které ostatní vlákna čekají
+			m_queueChanged.notify_all();
+		}
+	}
+
+	bool isValid(const Request & request) const
+	{
+		return request.isFlush || m_drive->isInRange(request.lba, request.count);
+	}
+
+	/**
+	 * @brief Zařadí požadavek do fronty. Volá se se zámkem fronty.
+	 * @return Chyba, pokud požadavek nelze zařadit, jinak No_Error.
+	 */
+	kiv_hal::NDisk_Status enqueue(const RequestPtr & request)
+	{
+		if (!isValid(*request))
+		{
+			// sloučený přenos by selhal i pro ostatní požadavky
+			return kiv_hal::NDisk_Status::Sector_Not_Found;
+		}
+
+		request->submitTime = std::chrono::steady_clock::now();
+
+		m_pending.push_back(request);
+
+		if (!request->isFlush)
+		{
+			m_stats.requests++;
+		}
+
+		m_queueChanged.notify_one();
+
+		return kiv_hal::NDisk_Status::No_Error;
+	}
+
+	/**
+	 * @brief Zařadí požadavky do fronty a čeká na dokončení všech.
+	 * @return Chyba prvního neúspěšného požadavku, jinak No_Error.
+	 */
+	kiv_hal::NDisk_Status execute(const std::vector<RequestPtr> & requests)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		// požadavky se zařadí buď všechny, nebo žádný
+		for (const RequestPtr & request : requests)
+		{
+			if (!isValid(*request))
+			{
+				return kiv_hal::NDisk_Status::Sector_Not_Found;
+			}
+		}
+
+		for (const RequestPtr & request : requests)
+		{
+			enqueue(request);
+		}
+
+		kiv_hal::NDisk_Status status = kiv_hal::NDisk_Status::No_Error;
+
+		for (const RequestPtr & request : requests)
+		{
+			m_requestCompleted.wait(lock, [&request] { return request->isDone; });
+
+			if (status == kiv_hal::NDisk_Status::No_Error)
+			{
+				status = request->status;
+			}
+		}
+
+		return status;
+	}
+
+public:
+	CDiskQueue(std::unique_ptr<IDiskDrive> drive)
+	: m_drive(std::move(drive)),
+	  m_mutex(),
+	  m_queueChanged(),
+	  m_requestCompleted(),
+	  m_pending(),
+	  m_active(),
+	  m_activeTransfers(0),
+	  m_headPosition(0),
+	  m_isStopping(false),
+	  m_stats(),
+	  m_threads()
+	{
+		const size_t threadCount = (m_drive->isConcurrent()) ? DISK_QUEUE_THREAD_COUNT : 1;
+
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			m_threads.emplace_back(&CDiskQueue::run, this);
+		}
+	}
+
+	~CDiskQueue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			m_isStopping = true;
+		}
+
+		m_queueChanged.notify_all();
+
+		for (std::thread & thread : m_threads)
+		{
+			thread.join();
+		}
+	}
+
+	IDiskDrive & getDrive()
+	{
+		return *m_drive;
+	}
+
+	/**
+	 * @brief Vyřídí Read_Sectors nebo Write_Sectors přes frontu a čeká na dokončení.
+	 */
+	void transferSectors(kiv_hal::TRegisters & context, bool isWrite)
+	{
+		kiv_hal::TDisk_Address_Packet *pDAP = reinterpret_cast<kiv_hal::TDisk_Address_Packet*>(context.rdi.r);
+
+		RequestPtr request = std::make_shared<Request>();
+		request->isWrite = isWrite;
+		request->lba = pDAP->lba_index;
+		request->count = pDAP->count;
+		request->buffer = static_cast<char*>(pDAP->sectors);
+
+		SetStatus(context, execute({ request }));
+	}
+
+	/**
+	 * @brief Vyřídí Read_Sectors_Vectored nebo Write_Sectors_Vectored.
+	 * Každý úsek je samostatný požadavek, takže se může spojit se sousedními úseky i s požadavky jiných vláken.
+	 */
+	void transferVector(kiv_hal::TRegisters & context, bool isWrite)
+	{
+		const kiv_hal::TDisk_Vector_Packet *pPacket = reinterpret_cast<kiv_hal::TDisk_Vector_Packet*>(context.rdi.r);
+
+		std::vector<RequestPtr> requests;
+		requests.reserve(static_cast<size_t>(pPacket->count));
+
+		for (uint64_t i = 0; i < pPacket->count; i++)
+		{
+			const kiv_hal::TDisk_Address_Packet & segment = pPacket->segments[i];
+
+			if (segment.count == 0)
+			{
+				continue;
 			}
+
+			RequestPtr request = std::make_shared<Request>();
+			request->isWrite = isWrite;
+			request->lba = segment.lba_index;
+			request->count = segment.count;
+			request->buffer = static_cast<char*>(segment.sectors);
+
+			requests.push_back(std::move(request));
 		}
+
+		SetStatus(context, execute(requests));
+	}
+
+	/**
+	 * @brief Vyřídí Flush. Čeká na dokončení všech dřívějších požadavků a zápis dat z paměti disku.
+	 */
+	void flush(kiv_hal::TRegisters & context)
+	{
+		RequestPtr request = std::make_shared<Request>();
+		request->isFlush = true;
+
+		SetStatus(context, execute({ request }));
+	}
+
+	/**
+	 * @brief Vyřídí Submit_Read_Sectors nebo Submit_Write_Sectors. Na dokončení nečeká.
+	 */
+	void submit(kiv_hal::TRegisters & context, bool isWrite)
+	{
+		kiv_hal::TDisk_Request *pAsyncRequest = reinterpret_cast<kiv_hal::TDisk_Request*>(context.rdi.r);
+
+		RequestPtr request = std::make_shared<Request>();
+		request->isWrite = isWrite;
+		request->lba = pAsyncRequest->packet.lba_index;
+		request->count = pAsyncRequest->packet.count;
+		request->buffer = static_cast<char*>(pAsyncRequest->packet.sectors);
+		request->pAsyncRequest = pAsyncRequest;
+
+		pAsyncRequest->completed.store(false, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const kiv_hal::NDisk_Status status = enqueue(request);
+		if (status != kiv_hal::NDisk_Status::No_Error)
+		{
+			// na nezařazený požadavek se nesmí čekat donekonečna
+			pAsyncRequest->status = status;
+			pAsyncRequest->completed.store(true, std::memory_order_release);
+		}
+
+		SetStatus(context, status);
+	}
+
+	/**
+	 * @brief Vyřídí Wait_For_Request.
+	 */
+	void wait(kiv_hal::TRegisters & context)
+	{
+		kiv_hal::TDisk_Request *pAsyncRequest = reinterpret_cast<kiv_hal::TDisk_Request*>(context.rdi.r);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_requestCompleted.wait(lock, [pAsyncRequest] { return pAsyncRequest->completed.load(); });
+
+		SetStatus(context, pAsyncRequest->status);
+	}
+
+	void getStatistics(kiv_hal::TRegisters & context)
+	{
+		kiv_hal::TDisk_Queue_Statistics *pStats = reinterpret_cast<kiv_hal::TDisk_Queue_Statistics*>(context.rdi.r);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		*pStats = m_stats;
+		pStats->modeled_time_us = m_drive->getModeledTime();
+
+		SetStatus(context, kiv_hal::NDisk_Status::No_Error);
+	}
+};
+
+static std::array<std::unique_ptr<CDiskQueue>, 256> g_diskQueues;
+static std::array<std::once_flag, 256> g_diskQueueInitFlags;
+
+/**
+ * @brief Vytvoří disk podle konfigurace a jeho frontu požadavků. Volá se jen jednou pro každý disk, i když se na něj
+ * poprvé obrátí více vláken najednou.
+ */
+static void InitDiskDrive(uint8_t diskIndex)
+{
+	const CMOS::DriveParameters params = CMOS::GetDriveParameters(diskIndex);
+
+	if (!params.isPresent)
+	{
+		return;
+	}
+
+	std::unique_ptr<IDiskDrive> drive;
+
+	if (params.isRAMDisk)
+	{
+		drive = std::make_unique<CRAMDisk>(params);
+	}
+	else if (params.hasOverlay)
+	{
+		drive = std::make_unique<COverlayDisk>(params);
+	}
+	else if (params.isMemoryMapped)
+	{
+		drive = std::make_unique<CMappedDiskImage>(params);
+	}
+	else
+	{
+		drive = std::make_unique<CDiskImage>(params);
+	}
+
+	if (params.hasLatencyModel)
+	{
+		drive = std::make_unique<CLatencyDisk>(params, std::move(drive));
 	}
 
-	if (g_diskDrives[diskIndex])
+	g_diskQueues[diskIndex] = std::make_unique<CDiskQueue>(std::move(drive));
+}
+
+void __stdcall Disk::InterruptHandler(kiv_hal::TRegisters & context)
+{
+	const uint8_t diskIndex = context.rdx.l;
+
+	std::call_once(g_diskQueueInitFlags[diskIndex], InitDiskDrive, diskIndex);
+
+	CDiskQueue *pQueue = g_diskQueues[diskIndex].get();
+
+	if (pQueue)
 	{
 		switch (static_cast<kiv_hal::NDisk_IO>(context.rax.h))
 		{
 			case kiv_hal::NDisk_IO::Read_Sectors:
 			{
-				g_diskDrives[diskIndex]->readSectors(context);
+				pQueue->transferSectors(context, false);
 				break;
 			}
 			case kiv_hal::NDisk_IO::Write_Sectors:
 			{
-				g_diskDrives[diskIndex]->writeSectors(context);
+				pQueue->transferSectors(context, true);
 				break;
 			}
 			case kiv_hal::NDisk_IO::Drive_Parameters:
 			{
-				g_diskDrives[diskIndex]->getDriveParameters(context);
+				pQueue->getDrive().getDriveParameters(context);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Submit_Read_Sectors:
+			{
+				pQueue->submit(context, false);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Submit_Write_Sectors:
+			{
+				pQueue->submit(context, true);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Wait_For_Request:
+			{
+				pQueue->wait(context);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Queue_Statistics:
+			{
+				pQueue->getStatistics(context);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Drive_Usage:
+			{
+				pQueue->getDrive().getUsage(context);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Flush:
+			{
+				pQueue->flush(context);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Read_Sectors_Vectored:
+			{
+				pQueue->transferVector(context, false);
+				break;
+			}
+			case kiv_hal::NDisk_IO::Write_Sectors_Vectored:
+			{
+				pQueue->transferVector(context, true);
 				break;
 			}
 			default:
@@ -0,0 +1,949 @@
+#include <cstring>
+#include <iterator>
+
+#include "../api/hal.h"
+
+#include "block_cache.h"
+#include "kernel.h"
+
+/**
+ * @brief Zavolá službu BIOSu pro čtení sektorů z disku.
+ */
+static EStatus HALReadSectors(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, char *buffer)
+{
+	kiv_hal::TRegisters registers;
+	kiv_hal::TDisk_Address_Packet addressPacket;
+
+	addressPacket.lba_index = lba;
+	addressPacket.count = sectorCount;
+	addressPacket.sectors = buffer;
+
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Read_Sectors);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&addressPacket);
+	registers.rdx.l = diskNumber;
+
+	DiskStatistics & stats = Kernel::GetDiskStatistics();
+	const DiskStatistics::TimePoint startTime = stats.onRequestStarted(diskNumber);
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	stats.onRequestFinished(diskNumber, false, sectorCount, startTime, !registers.flags.carry);
+
+	if (registers.flags.carry)
+	{
+		return EStatus::IO_ERROR;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Převede výsledek zápisu na disk.
+ */
+static EStatus WriteStatusToEStatus(kiv_hal::NDisk_Status status)
+{
+	switch (status)
+	{
+		case kiv_hal::NDisk_Status::No_Error:
+		{
+			return EStatus::SUCCESS;
+		}
+		case kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive:
+		{
+			// disk pouze pro čtení, stejně ale disk hlásí i selhání zápisu, viz BlockCache::getWriteStatus
+			return EStatus::PERMISSION_DENIED;
+		}
+		default:
+		{
+			return EStatus::IO_ERROR;
+		}
+	}
+}
+
+/**
+ * @brief Zavolá službu BIOSu pro zápis sektorů na disk.
+ */
+static EStatus HALWriteSectors(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, const char *buffer)
+{
+	kiv_hal::TRegisters registers;
+	kiv_hal::TDisk_Address_Packet addressPacket;
+
+	addressPacket.lba_index = lba;
+	addressPacket.count = sectorCount;
+	addressPacket.sectors = const_cast<char*>(buffer);
+
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Write_Sectors);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&addressPacket);
+	registers.rdx.l = diskNumber;
+
+	DiskStatistics & stats = Kernel::GetDiskStatistics();
+	const DiskStatistics::TimePoint startTime = stats.onRequestStarted(diskNumber);
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	stats.onRequestFinished(diskNumber, true, sectorCount, startTime, !registers.flags.carry);
+
+	if (registers.flags.carry)
+	{
+		return WriteStatusToEStatus(static_cast<kiv_hal::NDisk_Status>(registers.rax.x));
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Zavolá službu BIOSu pro přenos více úseků sektorů najednou.
+ */
+static EStatus HALTransferSegments(uint8_t diskNumber, const std::vector<BlockCache::Segment> & segments, bool isWrite)
+{
+	std::vector<kiv_hal::TDisk_Address_Packet> addressPackets(segments.size());
+	uint64_t sectorCount = 0;
+
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		addressPackets[i].lba_index = segments[i].lba;
+		addressPackets[i].count = segments[i].sectorCount;
+		addressPackets[i].sectors = segments[i].buffer;
+
+		sectorCount += segments[i].sectorCount;
+	}
+
+	kiv_hal::TDisk_Vector_Packet vectorPacket;
+	vectorPacket.count = addressPackets.size();
+	vectorPacket.segments = addressPackets.data();
+
+	kiv_hal::TRegisters registers;
+
+	const kiv_hal::NDisk_IO command = (isWrite) ? kiv_hal::NDisk_IO::Write_Sectors_Vectored
+	                                            : kiv_hal::NDisk_IO::Read_Sectors_Vectored;
+
+	registers.rax.h = static_cast<uint8_t>(command);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&vectorPacket);
+	registers.rdx.l = diskNumber;
+
+	DiskStatistics & stats = Kernel::GetDiskStatistics();
+	const DiskStatistics::TimePoint startTime = stats.onRequestStarted(diskNumber);
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	stats.onRequestFinished(diskNumber, isWrite, sectorCount, startTime, !registers.flags.carry);
+
+	if (registers.flags.carry)
+	{
+		return (isWrite) ? WriteStatusToEStatus(static_cast<kiv_hal::NDisk_Status>(registers.rax.x)) : EStatus::IO_ERROR;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Zařadí zápis sektorů do fronty disku a hned se vrátí. Na dokončení se čeká pomocí HALWaitForWrite.
+ * @param startTime Čas odeslání požadavku pro statistiky, předává se do HALWaitForWrite.
+ */
+static EStatus HALSubmitWriteSectors(uint8_t diskNumber, kiv_hal::TDisk_Request & request,
+                                     DiskStatistics::TimePoint & startTime)
+{
+	kiv_hal::TRegisters registers;
+
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Submit_Write_Sectors);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&request);
+	registers.rdx.l = diskNumber;
+
+	DiskStatistics & stats = Kernel::GetDiskStatistics();
+	startTime = stats.onRequestStarted(diskNumber);
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	if (registers.flags.carry)
+	{
+		stats.onRequestFinished(diskNumber, true, request.packet.count, startTime, false);
+
+		return WriteStatusToEStatus(static_cast<kiv_hal::NDisk_Status>(registers.rax.x));
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Počká na dokončení zápisu zařazeného pomocí HALSubmitWriteSectors.
+ */
+static EStatus HALWaitForWrite(uint8_t diskNumber, kiv_hal::TDisk_Request & request,
+                               DiskStatistics::TimePoint startTime)
+{
+	kiv_hal::TRegisters registers;
+
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Wait_For_Request);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&request);
+	registers.rdx.l = diskNumber;
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	Kernel::GetDiskStatistics().onRequestFinished(diskNumber, true, request.packet.count, startTime,
+	                                              !registers.flags.carry);
+
+	if (registers.flags.carry)
+	{
+		return WriteStatusToEStatus(static_cast<kiv_hal::NDisk_Status>(registers.rax.x));
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Zavolá službu BIOSu, která počká na dokončení všech dřívějších požadavků na disk a zapíše data, která disk
+ * drží v paměti, trvale do zařízení.
+ */
+static EStatus HALFlush(uint8_t diskNumber)
+{
+	kiv_hal::TRegisters registers;
+
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Flush);
+	registers.rdx.l = diskNumber;
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	if (registers.flags.carry)
+	{
+		return WriteStatusToEStatus(static_cast<kiv_hal::NDisk_Status>(registers.rax.x));
+	}
+
+	return EStatus::SUCCESS;
+}
+
+uint16_t BlockCache::getSectorSize(uint8_t diskNumber) const
+{
+	auto it = m_sectorSizes.find(diskNumber);
+
+	return (it != m_sectorSizes.end()) ? it->second : 0;
+}
+
+BlockCache::Block & BlockCache::insertBlock(uint8_t diskNumber, uint64_t lba, uint16_t sectorSize)
+{
+	const BlockKey key(diskNumber, lba);
+
+	m_lru.push_front(key);
+
+	Block & block = m_blocks[key];
+	block.data.resize(sectorSize);
+	block.isDirty = false;
+	block.lruIt = m_lru.begin();
+
+	m_size += sectorSize;
+
+	return block;
+}
+
+/**
+ * @brief Zkopíruje souvislý úsek sektorů <first, last) do jednoho bufferu pro zápis na disk.
+ */
+void BlockCache::gatherRun(BlockIterator first, BlockIterator last, std::vector<char> & buffer)
+{
+	const size_t sectorSize = first->second.data.size();
+
+	buffer.resize(static_cast<size_t>(std::distance(first, last)) * sectorSize);
+
+	size_t offset = 0;
+
+	for (auto it = first; it != last; ++it)
+	{
+		std::memcpy(buffer.data() + offset, it->second.data.data(), sectorSize);
+		offset += sectorSize;
+	}
+}
+
+/**
+ * @brief Upřesní výsledek zápisu na disk.
+ * Disk hlásí stejnou chybu, když je pouze pro čtení i když zápis selhal. Disk, který už nějaký zápis přijal, pouze pro
+ * čtení není, takže jeho chyba zápisu je chyba zařízení.
+ */
+EStatus BlockCache::getWriteStatus(uint8_t diskNumber, EStatus status) const
+{
+	if (status == EStatus::PERMISSION_DENIED && m_writableDisks.find(diskNumber) != m_writableDisks.end())
+	{
+		return EStatus::IO_ERROR;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Zpracuje výsledek zápisu souvislého úseku změněných sektorů <first, last) na disk.
+ * Pokud zápis selhal, sektory zůstanou v cache změněné a na disk se zkusí zapsat znovu. Změněné sektory mají jen disky,
+ * které už zápis přijaly, takže nejde o disk pouze pro čtení.
+ */
+EStatus BlockCache::finishWriteBack(BlockIterator first, BlockIterator last, EStatus status)
+{
+	status = getWriteStatus(first->first.first, status);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	for (auto it = first; it != last; ++it)
+	{
+		it->second.isDirty = false;
+	}
+
+	m_stats.writeBacks += static_cast<uint64_t>(std::distance(first, last));
+	m_writeBackGeneration++;
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Zapíše na disk souvislý úsek změněných sektorů <first, last). Během zápisu je zámek cache uvolněný.
+ * Sektory, které se během zápisu změnily, zůstanou změněné, protože na disku mohou být jejich starší data. Iterátory
+ * po návratu už nemusí být platné.
+ */
+EStatus BlockCache::writeBackRun(std::unique_lock<std::mutex> & lock, BlockIterator first, BlockIterator last)
+{
+	std::vector<char> buffer;
+	gatherRun(first, last, buffer);
+
+	const uint8_t diskNumber = first->first.first;
+	const uint64_t lba = first->first.second;
+	const uint64_t sectorCount = static_cast<uint64_t>(std::distance(first, last));
+
+	std::vector<uint64_t> versions;
+	versions.reserve(static_cast<size_t>(sectorCount));
+
+	for (auto it = first; it != last; ++it)
+	{
+		versions.push_back(it->second.version);
+		it->second.isWritingBack = true;
+	}
+
+	m_pendingWriteBacks++;
+
+	lock.unlock();
+
+	EStatus status = HALWriteSectors(diskNumber, lba, sectorCount, buffer.data());
+
+	lock.lock();
+
+	m_pendingWriteBacks--;
+
+	status = getWriteStatus(diskNumber, status);
+
+	for (uint64_t i = 0; i < sectorCount; i++)
+	{
+		auto it = m_blocks.find(BlockKey(diskNumber, lba + i));
+		if (it == m_blocks.end())
+		{
+			continue;
+		}
+
+		Block & block = it->second;
+
+		block.isWritingBack = false;
+
+		if (block.version != versions[static_cast<size_t>(i)])
+		{
+			block.isDirty = true;
+		}
+		else if (status == EStatus::SUCCESS)
+		{
+			block.isDirty = false;
+		}
+	}
+
+	if (status == EStatus::SUCCESS)
+	{
+		m_stats.writeBacks += sectorCount;
+		m_writeBackGeneration++;
+	}
+
+	m_writeBackCV.notify_all();
+
+	return status;
+}
+
+/**
+ * @brief Vytlačí nejdéle nepoužité sektory, dokud velikost cache nepřesahuje kapacitu.
+ * Chyba zápisu změněných sektorů se nevrací, protože se netýká operace, která vytlačení vyvolala. Takové sektory
+ * zůstanou v cache a na disk se znovu zkusí zapsat při dalším vytlačení nebo při flush.
+ */
+void BlockCache::evict(std::unique_lock<std::mutex> & lock)
+{
+	// sektory, které se během tohoto vytlačování nepodařilo zapsat
+	std::set<BlockKey> failedBlocks;
+
+	while (m_size > m_capacity)
+	{
+		auto it = m_blocks.end();
+
+		for (auto lruIt = m_lru.rbegin(); lruIt != m_lru.rend(); ++lruIt)
+		{
+			auto candidate = m_blocks.find(*lruIt);
+
+			if (!candidate->second.isWritingBack && failedBlocks.find(*lruIt) == failedBlocks.end())
+			{
+				it = candidate;
+				break;
+			}
+		}
+
+		if (it == m_blocks.end())
+		{
+			// žádný sektor teď nelze vytlačit
+			break;
+		}
+
+		if (!it->second.isDirty)
+		{
+			m_size -= it->second.data.size();
+			m_lru.erase(it->second.lruIt);
+			m_blocks.erase(it);
+
+			m_stats.evictions++;
+
+			continue;
+		}
+
+		const uint8_t diskNumber = it->first.first;
+
+		// spolu s vytlačovaným sektorem se zapíšou i sousední změněné sektory
+		auto first = it;
+		while (first != m_blocks.begin())
+		{
+			auto prev = std::prev(first);
+
+			if (prev->first.first != diskNumber || prev->first.second + 1 != first->first.second
+			 || !prev->second.isDirty || prev->second.isWritingBack)
+			{
+				break;
+			}
+
+			first = prev;
+		}
+
+		auto last = std::next(it);
+		while (last != m_blocks.end())
+		{
+			auto prev = std::prev(last);
+
+			if (last->first.first != diskNumber || prev->first.second + 1 != last->first.second
+			 || !last->second.isDirty || last->second.isWritingBack)
+			{
+				break;
+			}
+
+			++last;
+		}
+
+		const uint64_t lba = first->first.second;
+		const uint64_t sectorCount = static_cast<uint64_t>(std::distance(first, last));
+
+		// po úspěšném zápisu se sektor vytlačí v dalším průchodu jako nezměněný
+		if (writeBackRun(lock, first, last) != EStatus::SUCCESS)
+		{
+			for (uint64_t i = 0; i < sectorCount; i++)
+			{
+				failedBlocks.insert(BlockKey(diskNumber, lba + i));
+			}
+		}
+	}
+}
+
+/**
+ * @brief Počká na dokončení zápisů vytlačovaných sektorů, které probíhají bez zámku.
+ */
+void BlockCache::waitForWriteBacks(std::unique_lock<std::mutex> & lock)
+{
+	m_writeBackCV.wait(lock, [this]() { return m_pendingWriteBacks == 0; });
+}
+
+/**
+ * @brief Přečte sektory z disku. Během čtení je zámek cache uvolněný, aby mohla číst i další vlákna.
+ * Pokud se mezitím na disk zapisovalo, ať už změněné sektory z cache, které pak mohly být i vytlačeny, nebo přímé
+ * zápisy mimo cache, přečtená data mohou být starší než obsah disku. V takovém případě se čtení zopakuje se zámkem.
+ */
+EStatus BlockCache::readFromDisk(std::unique_lock<std::mutex> & lock, uint8_t diskNumber, uint64_t lba,
+                                 uint64_t sectorCount, char *buffer)
+{
+	const uint64_t writeBackGeneration = m_writeBackGeneration;
+
+	lock.unlock();
+
+	EStatus status = HALReadSectors(diskNumber, lba, sectorCount, buffer);
+
+	lock.lock();
+
+	if (status == EStatus::SUCCESS && writeBackGeneration != m_writeBackGeneration)
+	{
+		status = HALReadSectors(diskNumber, lba, sectorCount, buffer);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Přečte z disku více úseků sektorů jedním voláním. Zámek se uvolňuje stejně jako v readFromDisk.
+ */
+EStatus BlockCache::readSegmentsFromDisk(std::unique_lock<std::mutex> & lock, uint8_t diskNumber,
+                                         const std::vector<Segment> & segments)
+{
+	const uint64_t writeBackGeneration = m_writeBackGeneration;
+
+	lock.unlock();
+
+	EStatus status = HALTransferSegments(diskNumber, segments, false);
+
+	lock.lock();
+
+	if (status == EStatus::SUCCESS && writeBackGeneration != m_writeBackGeneration)
+	{
+		status = HALTransferSegments(diskNumber, segments, false);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Přepíše sektory přečtené z disku jejich kopiemi z cache, které jsou stejné nebo novější.
+ */
+void BlockCache::copyFromCache(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, char *buffer)
+{
+	const uint16_t sectorSize = getSectorSize(diskNumber);
+
+	auto it = m_blocks.lower_bound(BlockKey(diskNumber, lba));
+	while (it != m_blocks.end() && it->first.first == diskNumber && it->first.second < lba + sectorCount)
+	{
+		std::memcpy(buffer + (it->first.second - lba) * sectorSize, it->second.data.data(), sectorSize);
+
+		++it;
+	}
+}
+
+/**
+ * @brief Aktualizuje kopie sektorů zapsaných přímo na disk, aby cache odpovídala disku.
+ */
+void BlockCache::updateCache(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, const char *buffer)
+{
+	const uint16_t sectorSize = getSectorSize(diskNumber);
+
+	auto it = m_blocks.lower_bound(BlockKey(diskNumber, lba));
+	while (it != m_blocks.end() && it->first.first == diskNumber && it->first.second < lba + sectorCount)
+	{
+		std::memcpy(it->second.data.data(), buffer + (it->first.second - lba) * sectorSize, sectorSize);
+		it->second.version++;
+		it->second.isDirty = false;
+
+		++it;
+	}
+}
+
+/**
+ * @brief Zapíše na disk všechny změněné sektory disku.
+ * Všechny souvislé úseky se nejdřív zařadí do fronty disku a teprve pak se čeká na jejich dokončení, takže je disk
+ * může zapsat v pořadí, které mu vyhovuje.
+ */
+EStatus BlockCache::flushDisk(uint8_t diskNumber)
+{
+	struct WriteBack
+	{
+		BlockIterator first;
+		BlockIterator last;
+		std::vector<char> buffer;
+		kiv_hal::TDisk_Request request;
+		DiskStatistics::TimePoint startTime;
+		EStatus status;
+	};
+
+	// TDisk_Request nelze přesouvat, protože na něj odkazuje fronta disku
+	std::list<WriteBack> writeBacks;
+
+	auto it = m_blocks.lower_bound(BlockKey(diskNumber, 0));
+
+	while (it != m_blocks.end() && it->first.first == diskNumber)
+	{
+		if (!it->second.isDirty)
+		{
+			++it;
+			continue;
+		}
+
+		// souvislý úsek změněných sektorů se zapíše najednou
+		auto last = std::next(it);
+		while (last != m_blocks.end())
+		{
+			auto prev = std::prev(last);
+
+			if (last->first.first != diskNumber || prev->first.second + 1 != last->first.second || !last->second.isDirty)
+			{
+				break;
+			}
+
+			++last;
+		}
+
+		writeBacks.emplace_back();
+
+		WriteBack & writeBack = writeBacks.back();
+		writeBack.first = it;
+		writeBack.last = last;
+
+		gatherRun(it, last, writeBack.buffer);
+
+		writeBack.request.packet.lba_index = it->first.second;
+		writeBack.request.packet.count = static_cast<uint64_t>(std::distance(it, last));
+		writeBack.request.packet.sectors = writeBack.buffer.data();
+
+		writeBack.status = HALSubmitWriteSectors(diskNumber, writeBack.request, writeBack.startTime);
+
+		it = last;
+	}
+
+	EStatus result = EStatus::SUCCESS;
+
+	for (WriteBack & writeBack : writeBacks)
+	{
+		EStatus status = writeBack.status;
+		if (status == EStatus::SUCCESS)
+		{
+			status = HALWaitForWrite(diskNumber, writeBack.request, writeBack.startTime);
+		}
+
+		status = finishWriteBack(writeBack.first, writeBack.last, status);
+		if (status != EStatus::SUCCESS && result == EStatus::SUCCESS)
+		{
+			result = status;
+		}
+	}
+
+	return result;
+}
+
+void BlockCache::setSectorSize(uint8_t diskNumber, uint16_t bytesPerSector)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	const uint16_t oldSectorSize = getSectorSize(diskNumber);
+
+	if (oldSectorSize == bytesPerSector)
+	{
+		return;
+	}
+
+	if (oldSectorSize != 0)
+	{
+		// sektory v cache mají jinou velikost
+		waitForWriteBacks(lock);
+		flushDisk(diskNumber);
+
+		auto it = m_blocks.lower_bound(BlockKey(diskNumber, 0));
+		while (it != m_blocks.end() && it->first.first == diskNumber)
+		{
+			m_size -= it->second.data.size();
+			m_lru.erase(it->second.lruIt);
+			it = m_blocks.erase(it);
+		}
+	}
+
+	m_sectorSizes[diskNumber] = bytesPerSector;
+}
+
+EStatus BlockCache::setCapacity(size_t capacity)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_capacity = capacity;
+
+	evict(lock);
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::read(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, char *buffer)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	const uint16_t sectorSize = getSectorSize(diskNumber);
+
+	if (sectorSize == 0 || sectorCount > BLOCK_CACHE_MAX_CACHED_TRANSFER)
+	{
+		EStatus status = readFromDisk(lock, diskNumber, lba, sectorCount, buffer);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		m_stats.bypassedSectors += sectorCount;
+
+		copyFromCache(diskNumber, lba, sectorCount, buffer);
+
+		return EStatus::SUCCESS;
+	}
+
+	uint64_t i = 0;
+
+	while (i < sectorCount)
+	{
+		auto it = m_blocks.find(BlockKey(diskNumber, lba + i));
+		if (it != m_blocks.end())
+		{
+			std::memcpy(buffer + i * sectorSize, it->second.data.data(), sectorSize);
+
+			// sektor byl právě použit
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+
+			m_stats.hits++;
+			i++;
+
+			continue;
+		}
+
+		// souvislý úsek chybějících sektorů se načte najednou přímo do bufferu
+		uint64_t missCount = 1;
+		while (i + missCount < sectorCount && m_blocks.find(BlockKey(diskNumber, lba + i + missCount)) == m_blocks.end())
+		{
+			missCount++;
+		}
+
+		char *runBuffer = buffer + i * sectorSize;
+
+		EStatus status = readFromDisk(lock, diskNumber, lba + i, missCount, runBuffer);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		for (uint64_t j = 0; j < missCount; j++)
+		{
+			char *sector = runBuffer + j * sectorSize;
+
+			auto existing = m_blocks.find(BlockKey(diskNumber, lba + i + j));
+			if (existing != m_blocks.end())
+			{
+				// sektor mezitím do cache načetlo nebo zapsalo jiné vlákno a jeho kopie je aktuálnější
+				std::memcpy(sector, existing->second.data.data(), sectorSize);
+				continue;
+			}
+
+			Block & block = insertBlock(diskNumber, lba + i + j, sectorSize);
+
+			std::memcpy(block.data.data(), sector, sectorSize);
+		}
+
+		m_stats.misses += missCount;
+		i += missCount;
+	}
+
+	evict(lock);
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::write(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, const char *buffer)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	const uint16_t sectorSize = getSectorSize(diskNumber);
+
+	// disk, který ještě žádný zápis nepřijal, může být pouze pro čtení
+	const bool isWritable = m_writableDisks.find(diskNumber) != m_writableDisks.end();
+
+	if (sectorSize == 0 || sectorCount > BLOCK_CACHE_MAX_CACHED_TRANSFER || !isWritable)
+	{
+		EStatus status = getWriteStatus(diskNumber, HALWriteSectors(diskNumber, lba, sectorCount, buffer));
+
+		// čtení, která právě běží bez zámku, mohla přečíst data před tímto zápisem (i částečným)
+		m_writeBackGeneration++;
+
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		m_stats.bypassedSectors += sectorCount;
+		m_disksToFlush.insert(diskNumber);
+		m_writableDisks.insert(diskNumber);
+
+		updateCache(diskNumber, lba, sectorCount, buffer);
+
+		return EStatus::SUCCESS;
+	}
+
+	for (uint64_t i = 0; i < sectorCount; i++)
+	{
+		Block *pBlock;
+
+		auto it = m_blocks.find(BlockKey(diskNumber, lba + i));
+		if (it != m_blocks.end())
+		{
+			pBlock = &it->second;
+
+			m_lru.splice(m_lru.begin(), m_lru, pBlock->lruIt);
+		}
+		else
+		{
+			pBlock = &insertBlock(diskNumber, lba + i, sectorSize);
+		}
+
+		std::memcpy(pBlock->data.data(), buffer + i * sectorSize, sectorSize);
+		pBlock->version++;
+		pBlock->isDirty = true;
+	}
+
+	m_disksToFlush.insert(diskNumber);
+
+	evict(lock);
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::readSegments(uint8_t diskNumber, const std::vector<Segment> & segments)
+{
+	std::vector<Segment> uncachedSegments;
+
+	for (const Segment & segment : segments)
+	{
+		if (segment.sectorCount > BLOCK_CACHE_MAX_CACHED_TRANSFER)
+		{
+			uncachedSegments.push_back(segment);
+			continue;
+		}
+
+		// malé úseky jdou přes cache, většinou v ní už jsou
+		EStatus status = read(diskNumber, segment.lba, segment.sectorCount, segment.buffer);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+	}
+
+	if (uncachedSegments.empty())
+	{
+		return EStatus::SUCCESS;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	EStatus status = readSegmentsFromDisk(lock, diskNumber, uncachedSegments);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	for (const Segment & segment : uncachedSegments)
+	{
+		m_stats.bypassedSectors += segment.sectorCount;
+
+		copyFromCache(diskNumber, segment.lba, segment.sectorCount, segment.buffer);
+	}
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::writeSegments(uint8_t diskNumber, const std::vector<Segment> & segments)
+{
+	std::vector<Segment> uncachedSegments;
+
+	for (const Segment & segment : segments)
+	{
+		if (segment.sectorCount > BLOCK_CACHE_MAX_CACHED_TRANSFER)
+		{
+			uncachedSegments.push_back(segment);
+			continue;
+		}
+
+		EStatus status = write(diskNumber, segment.lba, segment.sectorCount, segment.buffer);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+	}
+
+	if (uncachedSegments.empty())
+	{
+		return EStatus::SUCCESS;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	EStatus status = getWriteStatus(diskNumber, HALTransferSegments(diskNumber, uncachedSegments, true));
+
+	// stejně jako v write
+	m_writeBackGeneration++;
+
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	m_disksToFlush.insert(diskNumber);
+	m_writableDisks.insert(diskNumber);
+
+	for (const Segment & segment : uncachedSegments)
+	{
+		m_stats.bypassedSectors += segment.sectorCount;
+
+		updateCache(diskNumber, segment.lba, segment.sectorCount, segment.buffer);
+	}
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::flush(uint8_t diskNumber)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	waitForWriteBacks(lock);
+
+	if (m_disksToFlush.find(diskNumber) == m_disksToFlush.end())
+	{
+		// od posledního Flush se na disk nic nezapsalo a nemá ani změněné sektory v cache
+		return EStatus::SUCCESS;
+	}
+
+	EStatus status = flushDisk(diskNumber);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	status = getWriteStatus(diskNumber, HALFlush(diskNumber));
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	m_disksToFlush.erase(diskNumber);
+
+	return EStatus::SUCCESS;
+}
+
+EStatus BlockCache::flushAll()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	waitForWriteBacks(lock);
+
+	EStatus result = EStatus::SUCCESS;
+
+	for (auto it = m_disksToFlush.begin(); it != m_disksToFlush.end();)
+	{
+		const uint8_t diskNumber = *it;
+
+		EStatus status = flushDisk(diskNumber);
+		if (status == EStatus::SUCCESS)
+		{
+			status = getWriteStatus(diskNumber, HALFlush(diskNumber));
+		}
+
+		if (status != EStatus::SUCCESS)
+		{
+			if (result == EStatus::SUCCESS)
+			{
+				result = status;
+			}
+
+			++it;
+			continue;
+		}
+
+		it = m_disksToFlush.erase(it);
+	}
+
+	return result;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "status.h"
+
+// výchozí maximální velikost dat v cache v bajtech
+#define BLOCK_CACHE_DEFAULT_CAPACITY  (4 * 1024 * 1024)
+
+// přenosy s více sektory se do cache neukládají, aby velké soubory nevytlačily metadata
+#define BLOCK_CACHE_MAX_CACHED_TRANSFER  64
+
+/**
+ * @brief Cache sektorů disků mezi souborovými systémy a službou Disk_IO.
+ * Sektory jsou identifikované číslem disku a LBA. Zápisy menší než BLOCK_CACHE_MAX_CACHED_TRANSFER sektorů se
+ * provádí pouze do cache (write-back) a na disk se dostanou až při vytlačení z cache nebo při volání flush. Větší
+ * přenosy jdou přímo na disk, cache se pouze udržuje konzistentní. Při překročení kapacity se zahazují nejdéle
+ * nepoužité sektory.
+ *
+ * Disk se do cache zapojí až po nastavení velikosti sektoru, do té doby jdou všechny přenosy přímo na disk. Zápisy jdou
+ * přímo na disk také do prvního úspěšného zápisu, takže disk pouze pro čtení odmítne každý zápis hned a data se
+ * neztratí až při pozdějším zápisu z cache.
+ *
+ * Čtení z disku probíhá bez zámku cache, takže více vláken může číst současně. Bez zámku se zapisují i změněné sektory
+ * vytlačované z cache. Pokud jejich zápis selže, zůstanou v cache změněné a vytlačí se jiné sektory. Ostatní zápisy na
+ * disk se provádí se zámkem.
+ */
+class BlockCache
+{
+public:
+	struct Statistics
+	{
+		uint64_t hits = 0;             // počet sektorů nalezených v cache
+		uint64_t misses = 0;           // počet sektorů, které bylo nutné načíst z disku
+		uint64_t bypassedSectors = 0;  // počet sektorů přenesených mimo cache
+		uint64_t writeBacks = 0;       // počet sektorů zapsaných z cache na disk
+		uint64_t evictions = 0;        // počet sektorů vytlačených z cache
+	};
+
+	// souvislý úsek sektorů pro readSegments a writeSegments
+	struct Segment
+	{
+		uint64_t lba;
+		uint64_t sectorCount;
+		char *buffer;
+	};
+
+private:
+	using BlockKey = std::pair<uint8_t, uint64_t>;  // číslo disku a LBA
+	using LRUList = std::list<BlockKey>;
+
+	struct Block
+	{
+		std::vector<char> data;
+		uint64_t version = 0;         // zvyšuje se při každé změně dat sektoru
+		bool isDirty = false;
+		bool isWritingBack = false;   // sektor se právě bez zámku zapisuje na disk
+		LRUList::iterator lruIt;
+	};
+
+	std::mutex m_mutex;
+	std::map<BlockKey, Block> m_blocks;       // seřazené podle disku a LBA, aby šlo zapisovat souvislé úseky
+	LRUList m_lru;                            // nejdéle nepoužitý sektor je na konci
+	std::map<uint8_t, uint16_t> m_sectorSizes;
+	std::set<uint8_t> m_disksToFlush;         // disky se změnami od posledního Flush, ostatním se Flush neposílá
+	std::set<uint8_t> m_writableDisks;        // disky, které už přijaly zápis
+	size_t m_capacity;
+	size_t m_size;
+	uint64_t m_writeBackGeneration;           // zvyšuje se při každém zápisu na disk, z cache i mimo ni
+	size_t m_pendingWriteBacks;               // počet zápisů vytlačovaných sektorů probíhajících bez zámku
+	std::condition_variable m_writeBackCV;    // signalizuje dokončení zápisu vytlačovaných sektorů
+	Statistics m_stats;
+
+	uint16_t getSectorSize(uint8_t diskNumber) const;
+
+	using BlockIterator = std::map<BlockKey, Block>::iterator;
+
+	Block & insertBlock(uint8_t diskNumber, uint64_t lba, uint16_t sectorSize);
+	void evict(std::unique_lock<std::mutex> & lock);
+	void waitForWriteBacks(std::unique_lock<std::mutex> & lock);
+	void gatherRun(BlockIterator first, BlockIterator last, std::vector<char> & buffer);
+	EStatus getWriteStatus(uint8_t diskNumber, EStatus status) const;
+	EStatus finishWriteBack(BlockIterator first, BlockIterator last, EStatus status);
+	EStatus writeBackRun(std::unique_lock<std::mutex> & lock, BlockIterator first, BlockIterator last);
+	EStatus flushDisk(uint8_t diskNumber);
+	EStatus readFromDisk(std::unique_lock<std::mutex> & lock, uint8_t diskNumber, uint64_t lba, uint64_t sectorCount,
+	                     char *buffer);
+	EStatus readSegmentsFromDisk(std::unique_lock<std::mutex> & lock, uint8_t diskNumber,
+	                             const std::vector<Segment> & segments);
+	void copyFromCache(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, char *buffer);
+	void updateCache(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, const char *buffer);
+
+public:
+	BlockCache(size_t capacity = BLOCK_CACHE_DEFAULT_CAPACITY)
+	: m_mutex(),
+	  m_blocks(),
+	  m_lru(),
+	  m_sectorSizes(),
+	  m_disksToFlush(),
+	  m_writableDisks(),
+	  m_capacity(capacity),
+	  m_size(0),
+	  m_writeBackGeneration(0),
+	  m_pendingWriteBacks(0),
+	  m_writeBackCV(),
+	  m_stats()
+	{
+	}
+
+	/**
+	 * @brief Zapojí disk do cache. Dokud není velikost sektoru disku známá, jdou přenosy přímo na disk.
+	 */
+	void setSectorSize(uint8_t diskNumber, uint16_t bytesPerSector);
+
+	/**
+	 * @brief Změní maximální velikost dat v cache. Při zmenšení se nadbytečné sektory hned vytlačí.
+	 */
+	EStatus setCapacity(size_t capacity);
+
+	EStatus read(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, char *buffer);
+	EStatus write(uint8_t diskNumber, uint64_t lba, uint64_t sectorCount, const char *buffer);
+
+	/**
+	 * @brief Přečte více úseků sektorů. Úseky, které se neukládají do cache, se přečtou jedním voláním disku.
+	 */
+	EStatus readSegments(uint8_t diskNumber, const std::vector<Segment> & segments);
+
+	/**
+	 * @brief Zapíše více úseků sektorů. Úseky, které se neukládají do cache, se zapíšou jedním voláním disku.
+	 */
+	EStatus writeSegments(uint8_t diskNumber, const std::vector<Segment> & segments);
+
+	/**
+	 * @brief Zapíše na disk všechny změněné sektory daného disku a pošle mu Flush, aby je zapsal trvale.
+	 * Volá se jen v místech, kde musí být změny na disku (zápis FAT, vypnutí systému). Pokud se na disk od posledního
+	 * Flush nic nezapsalo, nedělá nic.
+	 */
+	EStatus flush(uint8_t diskNumber);
+
+	/**
+	 * @brief Zapíše na disk všechny změněné sektory všech disků a každému disku se změnami pošle Flush.
+	 */
+	EStatus flushAll();
+
+	Statistics getStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		return m_stats;
+	}
+};
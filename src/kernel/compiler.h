@@ -7,11 +7,40 @@
 
 #define COMPILER_PRINTF_ARGS_CHECK(...) __attribute__((format(printf,__VA_ARGS__)))
 
+// index nejnižšího nastaveného bitu, x nesmí být 0
+#define COMPILER_COUNT_TRAILING_ZEROS_64(x) static_cast<unsigned int>(__builtin_ctzll(x))
+
 #else
 // =============
 // == MSVC :( ==
 // =============
 
+#include <intrin.h>
+
 #define COMPILER_PRINTF_ARGS_CHECK(...)
 
+inline unsigned int CompilerCountTrailingZeros64(unsigned __int64 x)
+{
+	unsigned long index = 0;
+
+#if !defined(_M_X64) && !defined(_M_ARM64)
+	// _BitScanForward64 je dostupný jen v 64bitovém překladu
+	if (_BitScanForward(&index, static_cast<unsigned long>(x)))
+	{
+		return index;
+	}
+
+	_BitScanForward(&index, static_cast<unsigned long>(x >> 32));
+
+	return index + 32;
+#else
+	_BitScanForward64(&index, x);
+
+	return index;
+#endif
+}
+
+// index nejnižšího nastaveného bitu, x nesmí být 0
+#define COMPILER_COUNT_TRAILING_ZEROS_64(x) CompilerCountTrailingZeros64(x)
+
 #endif
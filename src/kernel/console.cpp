@@ -33,6 +33,36 @@ EStatus Console::read(char *buffer, size_t bufferSize, size_t *pRead)
 	return EStatus::SUCCESS;
 }
 
+EStatus Console::readNonBlocking(char *buffer, size_t bufferSize, size_t *pRead)
+{
+	if (!m_pReader->tryReadLine(buffer, bufferSize, pRead))
+	{
+		if (pRead)
+		{
+			(*pRead) = 0;
+		}
+
+		return EStatus::WOULD_BLOCK;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+bool Console::isReadable()
+{
+	return m_pReader->hasLine();
+}
+
+void Console::addReadinessWaiter()
+{
+	m_pReader->addReadinessWaiter();
+}
+
+void Console::removeReadinessWaiter()
+{
+	m_pReader->removeReadinessWaiter();
+}
+
 EStatus Console::write(const char *buffer, size_t bufferSize, size_t *pWritten)
 {
 	std::lock_guard<std::mutex> lock(m_writerMutex);
@@ -30,6 +30,13 @@ public:
 	EStatus read(char *buffer, size_t bufferSize, size_t *pRead) override;
 	EStatus write(const char *buffer, size_t bufferSize, size_t *pWritten) override;
 
+	EStatus readNonBlocking(char *buffer, size_t bufferSize, size_t *pRead) override;
+
+	bool isReadable() override;
+
+	void addReadinessWaiter() override;
+	void removeReadinessWaiter() override;
+
 	void log(const char *format, ...) COMPILER_PRINTF_ARGS_CHECK(2,3);
 	void logV(const char *format, va_list args);
 };
@@ -4,6 +4,7 @@
 #include "../api/hal.h"
 
 #include "console_reader.h"
+#include "kernel.h"
 
 class ReaderCountGuard
 {
@@ -138,8 +139,9 @@ bool ConsoleReader::waitForReader()
 	{
 		m_workerCV.wait(lock);
 
-		if (getReaderCount() > 0)
+		if (getReaderCount() > 0 || m_readinessWaiterCount > 0 || m_isInputRequested)
 		{
+			m_isInputRequested = false;
 			return true;
 		}
 	}
@@ -165,6 +167,59 @@ void ConsoleReader::readLine(char *buffer, size_t bufferSize, size_t *pRead)
 		while (m_lineQueue.empty() && isOpen());
 	}
 
+	popLine(buffer, bufferSize, pRead);
+}
+
+bool ConsoleReader::tryReadLine(char *buffer, size_t bufferSize, size_t *pRead)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_lineQueue.empty() && isOpen())
+	{
+		requestInput();
+		return false;
+	}
+
+	popLine(buffer, bufferSize, pRead);
+
+	return true;
+}
+
+bool ConsoleReader::hasLine()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return !m_lineQueue.empty() || !isOpen();
+}
+
+void ConsoleReader::addReadinessWaiter()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_readinessWaiterCount++;
+
+	if (m_lineQueue.empty())
+	{
+		m_workerCV.notify_one();
+	}
+}
+
+void ConsoleReader::removeReadinessWaiter()
+{
+	m_readinessWaiterCount--;
+}
+
+// musí se volat se zamčeným m_mutex
+void ConsoleReader::requestInput()
+{
+	m_isInputRequested = true;
+
+	m_workerCV.notify_one();
+}
+
+// musí se volat se zamčeným m_mutex
+void ConsoleReader::popLine(char *buffer, size_t bufferSize, size_t *pRead)
+{
 	size_t length = 0;
 
 	if (!m_lineQueue.empty())
@@ -199,6 +254,11 @@ void ConsoleReader::pushLine(std::string && line)
 
 	lock.unlock();
 	m_readerCV.notify_one();
+
+	if (m_readinessWaiterCount > 0)
+	{
+		Kernel::GetEventSystem().dispatchEvent(Event::FILE_READABLE, Kernel::GetConsoleHandle().getID());
+	}
 }
 
 void ConsoleReader::close()
@@ -209,6 +269,12 @@ void ConsoleReader::close()
 
 		m_readerCV.notify_all();
 		m_workerCV.notify_all();
+
+		// uzavřený vstup je připravený ke čtení, čtení už vrátí konec dat
+		if (m_readinessWaiterCount > 0)
+		{
+			Kernel::GetEventSystem().dispatchEvent(Event::FILE_READABLE, Kernel::GetConsoleHandle().getID());
+		}
 	}
 }
 
@@ -10,6 +10,8 @@ class ConsoleReader
 {
 	std::atomic<bool> m_isOpen;
 	std::atomic<unsigned int> m_readerCount;
+	std::atomic<unsigned int> m_readinessWaiterCount{0};  // vlákna čekající v EventSystem na řádek ze vstupu
+	bool m_isInputRequested = false;                   // neblokující čtení chce, aby se načetl další řádek
 	std::queue<std::string> m_lineQueue;
 	std::condition_variable m_readerCV;
 	std::condition_variable m_workerCV;
@@ -24,6 +26,8 @@ class ConsoleReader
 
 	void workerLoop();
 	bool waitForReader();
+	void popLine(char *buffer, size_t bufferSize, size_t *pRead);
+	void requestInput();
 
 	friend class ReaderCountGuard;
 
@@ -40,6 +44,19 @@ public:
 
 	void readLine(char *buffer, size_t bufferSize, size_t *pRead);
 
+	/**
+	 * @brief Přečte řádek jen tehdy, pokud už je načtený. Jinak požádá o načtení dalšího řádku a vrátí false.
+	 */
+	bool tryReadLine(char *buffer, size_t bufferSize, size_t *pRead);
+
+	/**
+	 * @brief Zda je načtený řádek ke čtení nebo je vstup uzavřený.
+	 */
+	bool hasLine();
+
+	void addReadinessWaiter();
+	void removeReadinessWaiter();
+
 	void pushLine(std::string && line);
 
 	void close();
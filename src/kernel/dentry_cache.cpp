@@ -0,0 +1,91 @@
+#include "dentry_cache.h"
+
+const DentryCache::Entry *DentryCache::find(const std::string & path)
+{
+	auto it = m_entries.find(path);
+	if (it == m_entries.end())
+	{
+		m_stats.misses++;
+		return nullptr;
+	}
+
+	// položka byla právě použita
+	m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+
+	if (it->second.entry.status == EStatus::SUCCESS)
+	{
+		m_stats.hits++;
+	}
+	else
+	{
+		m_stats.negativeHits++;
+	}
+
+	return &it->second.entry;
+}
+
+const DentryCache::Entry *DentryCache::insert(const std::string & path, const Entry & entry)
+{
+	auto it = m_entries.find(path);
+	if (it != m_entries.end())
+	{
+		it->second.entry = entry;
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+
+		return &it->second.entry;
+	}
+
+	if (m_entries.size() >= m_capacity && !m_lru.empty())
+	{
+		// zahodíme nejdéle nepoužitou položku
+		m_entries.erase(m_lru.back());
+		m_lru.pop_back();
+	}
+
+	m_lru.push_front(path);
+
+	Node & node = m_entries[path];
+	node.entry = entry;
+	node.lruIt = m_lru.begin();
+
+	return &node.entry;
+}
+
+void DentryCache::update(const std::string & path, const FAT::Directory & file)
+{
+	auto it = m_entries.find(path);
+	if (it != m_entries.end() && it->second.entry.status == EStatus::SUCCESS)
+	{
+		it->second.entry.file = file;
+	}
+}
+
+void DentryCache::remove(const std::string & path)
+{
+	auto it = m_entries.find(path);
+	if (it != m_entries.end())
+	{
+		m_lru.erase(it->second.lruIt);
+		m_entries.erase(it);
+	}
+}
+
+void DentryCache::removeTree(const std::string & path)
+{
+	const std::string prefix = path + '\\';
+
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		const std::string & key = it->first;
+
+		if (key == path || key.compare(0, prefix.length(), prefix) == 0)
+		{
+			m_lru.erase(it->second.lruIt);
+			it = m_entries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
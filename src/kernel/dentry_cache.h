@@ -0,0 +1,90 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "fat.h"
+
+/**
+ * @brief Cache výsledků hledání souborů podle cesty.
+ * Klíčem je celá cesta včetně písmena disku (např. "C:\a\b"). Pamatuje si i negativní výsledky (soubor neexistuje), aby
+ * opakované hledání neexistujících souborů nečetlo adresáře z disku. Při zaplnění se zahazují nejdéle nepoužité
+ * položky.
+ */
+class DentryCache
+{
+public:
+	struct Entry
+	{
+		EStatus status = EStatus::FILE_NOT_FOUND;  // SUCCESS nebo FILE_NOT_FOUND pro negativní položku
+		FAT::Directory file;                       // nalezený soubor
+		FAT::Directory parent;                     // adresář, ve kterém se soubor hledal
+		uint32_t matchCounter = 0;                 // počet nalezených částí cesty, stejně jako ve FAT::FindFile
+	};
+
+	struct Statistics
+	{
+		uint64_t hits = 0;
+		uint64_t negativeHits = 0;
+		uint64_t misses = 0;
+	};
+
+private:
+	using LRUList = std::list<std::string>;
+
+	struct Node
+	{
+		Entry entry;
+		LRUList::iterator lruIt;
+	};
+
+	std::unordered_map<std::string, Node> m_entries;
+	LRUList m_lru;  // nejdéle nepoužitá položka je na konci
+	size_t m_capacity;
+	Statistics m_stats;
+
+public:
+	DentryCache(size_t capacity)
+	: m_entries(),
+	  m_lru(),
+	  m_capacity(capacity),
+	  m_stats()
+	{
+	}
+
+	/**
+	 * @brief Vrátí položku pro danou cestu nebo nullptr, pokud v cache není.
+	 * Vrácený ukazatel je platný jen do další změny cache.
+	 */
+	const Entry *find(const std::string & path);
+
+	const Entry *insert(const std::string & path, const Entry & entry);
+
+	/**
+	 * @brief Aktualizuje uložený záznam souboru (např. po změně velikosti). Pokud cesta v cache není, nic nedělá.
+	 */
+	void update(const std::string & path, const FAT::Directory & file);
+
+	/**
+	 * @brief Odstraní položku pro danou cestu. Položky pod ní zůstanou v cache.
+	 */
+	void remove(const std::string & path);
+
+	/**
+	 * @brief Odstraní položku pro danou cestu a všechny položky pod ní (včetně negativních).
+	 * Prochází celou cache, takže se používá jen tam, kde pod cestou mohou nějaké položky být.
+	 */
+	void removeTree(const std::string & path);
+
+	void clear()
+	{
+		m_entries.clear();
+		m_lru.clear();
+	}
+
+	const Statistics & getStatistics() const
+	{
+		return m_stats;
+	}
+};
@@ -0,0 +1,135 @@
+#include "disk_statistics.h"
+
+/**
+ * @brief Vrátí index intervalu histogramu pro dobu trvání v mikrosekundách.
+ */
+static size_t GetLatencyBucket(uint64_t latency)
+{
+	size_t bucket = 0;
+
+	while (latency > 1 && bucket < DISK_STATISTICS_LATENCY_BUCKETS - 1)
+	{
+		latency >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static bool HALGetDriveParameters(uint8_t diskNumber, kiv_hal::TDrive_Parameters & driveParams)
+{
+	kiv_hal::TRegisters registers;
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Drive_Parameters);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&driveParams);
+	registers.rdx.l = diskNumber;
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	return !registers.flags.carry;
+}
+
+static bool HALGetQueueStatistics(uint8_t diskNumber, kiv_hal::TDisk_Queue_Statistics & queueStats)
+{
+	kiv_hal::TRegisters registers;
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Queue_Statistics);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&queueStats);
+	registers.rdx.l = diskNumber;
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	return !registers.flags.carry;
+}
+
+static bool HALGetUsage(uint8_t diskNumber, kiv_hal::TDisk_Usage & usage)
+{
+	kiv_hal::TRegisters registers;
+	registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Drive_Usage);
+	registers.rdi.r = reinterpret_cast<uint64_t>(&usage);
+	registers.rdx.l = diskNumber;
+
+	kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+
+	return !registers.flags.carry;
+}
+
+DiskStatistics::TimePoint DiskStatistics::onRequestStarted(uint8_t diskNumber)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Disk & disk = m_disks[diskNumber];
+
+	disk.queueDepth++;
+
+	if (disk.queueDepth > disk.maxQueueDepth)
+	{
+		disk.maxQueueDepth = disk.queueDepth;
+	}
+
+	return std::chrono::steady_clock::now();
+}
+
+void DiskStatistics::onRequestFinished(uint8_t diskNumber, bool isWrite, uint64_t sectorCount, TimePoint startTime,
+                                       bool isSuccess)
+{
+	const auto duration = std::chrono::steady_clock::now() - startTime;
+	const uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Disk & disk = m_disks[diskNumber];
+
+	disk.queueDepth--;
+
+	Operation & operation = (isWrite) ? disk.writes : disk.reads;
+
+	operation.requests++;
+
+	if (isSuccess)
+	{
+		operation.sectors += sectorCount;
+	}
+	else
+	{
+		operation.errors++;
+	}
+
+	operation.totalLatency += latency;
+
+	if (latency > operation.maxLatency)
+	{
+		operation.maxLatency = latency;
+	}
+
+	operation.latencyHistogram[GetLatencyBucket(latency)]++;
+}
+
+bool DiskStatistics::getStatistics(uint8_t diskNumber, Disk & result)
+{
+	kiv_hal::TDrive_Parameters driveParams;
+	if (!HALGetDriveParameters(diskNumber, driveParams))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_disks.find(diskNumber);
+
+		result = (it != m_disks.end()) ? it->second : Disk();
+	}
+
+	result.bytesPerSector = driveParams.bytes_per_sector;
+
+	if (!HALGetQueueStatistics(diskNumber, result.queue))
+	{
+		result.queue = {};
+	}
+
+	if (!HALGetUsage(diskNumber, result.usage))
+	{
+		result.usage = {};
+	}
+
+	return true;
+}
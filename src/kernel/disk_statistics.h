@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include "../api/hal.h"  // kiv_hal::TDisk_Queue_Statistics, kiv_hal::TDisk_Usage
+
+#include "types.h"
+
+// počet intervalů histogramu dob trvání v mikrosekundách
+// interval i obsahuje doby <2^i, 2^(i+1)), interval 0 navíc kratší doby a poslední interval všechny delší
+#define DISK_STATISTICS_LATENCY_BUCKETS  24
+
+/**
+ * @brief Statistiky požadavků jádra na diskovou službu HAL podle čísla disku.
+ * Doba trvání požadavku se měří od jeho odeslání do HAL až po jeho dokončení, zahrnuje tedy i čekání ve frontě disku.
+ */
+class DiskStatistics
+{
+public:
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	struct Operation
+	{
+		uint64_t requests = 0;      // počet požadavků
+		uint64_t sectors = 0;       // počet přenesených sektorů
+		uint64_t errors = 0;        // počet neúspěšných požadavků
+		uint64_t totalLatency = 0;  // součet dob trvání v mikrosekundách
+		uint64_t maxLatency = 0;    // nejdelší doba trvání v mikrosekundách
+		std::array<uint64_t, DISK_STATISTICS_LATENCY_BUCKETS> latencyHistogram = {};
+	};
+
+	struct Disk
+	{
+		Operation reads;
+		Operation writes;
+		uint32_t queueDepth = 0;               // počet právě probíhajících požadavků
+		uint32_t maxQueueDepth = 0;            // nejvyšší počet současně probíhajících požadavků
+		uint16_t bytesPerSector = 0;           // zjišťuje se až při čtení statistik
+		kiv_hal::TDisk_Queue_Statistics queue = {};  // statistiky fronty disku v HAL
+		kiv_hal::TDisk_Usage usage = {};             // velikost disku a paměť, kterou v HAL skutečně zabírá
+	};
+
+private:
+	std::mutex m_mutex;
+	std::map<uint8_t, Disk> m_disks;
+
+public:
+	DiskStatistics()
+	: m_mutex(),
+	  m_disks()
+	{
+	}
+
+	/**
+	 * @brief Zaznamená odeslání požadavku do HAL.
+	 * @return Čas odeslání, který se potom předá do onRequestFinished.
+	 */
+	TimePoint onRequestStarted(uint8_t diskNumber);
+
+	/**
+	 * @brief Zaznamená dokončení požadavku odeslaného v čase startTime.
+	 */
+	void onRequestFinished(uint8_t diskNumber, bool isWrite, uint64_t sectorCount, TimePoint startTime, bool isSuccess);
+
+	/**
+	 * @brief Vrátí statistiky disku doplněné o velikost sektoru, statistiky fronty disku a využití paměti v HAL.
+	 * @return False, pokud disk neexistuje, jinak true.
+	 */
+	bool getStatistics(uint8_t diskNumber, Disk & result);
+};
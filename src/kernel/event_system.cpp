@@ -88,6 +88,29 @@ static bool ValidateHandles(const HandleID *handles, uint16_t handleCount, int e
 				currentState = handle.as<Process>()->isRunning() ? Event::PROCESS_START : Event::PROCESS_END;
 				break;
 			}
+			case EHandle::FILE:
+			{
+				if (!(events & (Event::FILE_READABLE | Event::FILE_WRITABLE)))
+				{
+					// na soubor se dá čekat jen s událostmi připravenosti
+					// konec validace
+					return false;
+				}
+
+				IFileHandle *pFile = handle.as<IFileHandle>();
+
+				if (pFile->isReadable())
+				{
+					currentState |= Event::FILE_READABLE;
+				}
+
+				if (pFile->isWritable())
+				{
+					currentState |= Event::FILE_WRITABLE;
+				}
+
+				break;
+			}
 			default:
 			{
 				// na tento typ handle se nedá čekat
@@ -111,6 +134,44 @@ static bool ValidateHandles(const HandleID *handles, uint16_t handleCount, int e
 	return Thread::GetProcess().forEachHandle(handles, handleCount, callback);
 }
 
+/**
+ * @brief Po dobu čekání drží soubory, na jejichž připravenost se čeká, a je v nich přihlášená jako čekající vlákno.
+ * Přihlásit se je nutné ještě před kontrolou stavu souborů, aby se žádná změna připravenosti neztratila.
+ */
+class ReadinessWaiterGuard
+{
+	std::vector<HandleReference> m_files;
+
+public:
+	ReadinessWaiterGuard(const HandleID *handles, uint16_t handleCount, int events)
+	: m_files()
+	{
+		if (events & (Event::FILE_READABLE | Event::FILE_WRITABLE))
+		{
+			Process & currentProcess = Thread::GetProcess();
+
+			for (uint16_t i = 0; i < handleCount; i++)
+			{
+				// neplatné handle zachytí až ValidateHandles
+				HandleReference file = currentProcess.getHandleOfType(handles[i], EHandle::FILE);
+				if (file)
+				{
+					file.as<IFileHandle>()->addReadinessWaiter();
+					m_files.push_back(std::move(file));
+				}
+			}
+		}
+	}
+
+	~ReadinessWaiterGuard()
+	{
+		for (const HandleReference & file : m_files)
+		{
+			file.as<IFileHandle>()->removeReadinessWaiter();
+		}
+	}
+};
+
 EStatus EventSystem::waitForMultiple(const HandleID *handles, uint16_t handleCount, int events, uint16_t & result)
 {
 	if (!events)
@@ -118,6 +179,8 @@ EStatus EventSystem::waitForMultiple(const HandleID *handles, uint16_t handleCou
 		return EStatus::INVALID_ARGUMENT;
 	}
 
+	ReadinessWaiterGuard readinessWaiterGuard(handles, handleCount, events);
+
 	// během kontroly jednotlivých handle je potřeba pozdržet všechny příchozí události, aby se předešlo race condition
 	std::unique_lock<std::mutex> lock(m_mutex);
 
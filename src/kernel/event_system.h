@@ -12,7 +12,9 @@ namespace Event
 		THREAD_START  = (1 << 0),
 		THREAD_END    = (1 << 1),
 		PROCESS_START = (1 << 2),
-		PROCESS_END   = (1 << 3)
+		PROCESS_END   = (1 << 3),
+		FILE_READABLE = (1 << 4),  // ze souboru lze číst bez blokování
+		FILE_WRITABLE = (1 << 5)   // do souboru lze zapisovat bez blokování
 	};
 }
 
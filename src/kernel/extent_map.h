@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "types.h"
+
+/**
+ * @brief Mapa souvislých úseků clusterů otevřeného souboru.
+ * Převádí pořadové číslo clusteru v souboru na cluster na disku bez procházení řetězce clusterů. Mapu sestavuje a
+ * kontroluje souborový systém, handle souboru ji pouze drží mezi jednotlivými operacemi.
+ */
+class ExtentMap
+{
+public:
+	struct Extent
+	{
+		uint64_t logicalStart;   // pořadové číslo prvního clusteru úseku v souboru
+		int64_t physicalStart;   // první cluster úseku na disku
+		uint64_t length;         // počet clusterů v úseku
+	};
+
+private:
+	std::vector<Extent> m_extents;
+	uint64_t m_clusterCount;
+	int64_t m_owner;             // identifikace souboru, pro který mapa platí
+	uint64_t m_version;          // verze souboru v době sestavení mapy
+	bool m_isValid;
+
+public:
+	ExtentMap()
+	: m_extents(),
+	  m_clusterCount(0),
+	  m_owner(-1),
+	  m_version(0),
+	  m_isValid(false)
+	{
+	}
+
+	void clear()
+	{
+		m_extents.clear();
+		m_clusterCount = 0;
+		m_isValid = false;
+	}
+
+	/**
+	 * @brief Přidá clustery na konec souboru. Pokud navazují na poslední úsek, pouze ho prodlouží.
+	 */
+	void append(int64_t physicalStart, uint64_t length)
+	{
+		if (!m_extents.empty())
+		{
+			Extent & last = m_extents.back();
+
+			if (last.physicalStart + static_cast<int64_t>(last.length) == physicalStart)
+			{
+				last.length += length;
+				m_clusterCount += length;
+				return;
+			}
+		}
+
+		m_extents.push_back(Extent{ m_clusterCount, physicalStart, length });
+		m_clusterCount += length;
+	}
+
+	/**
+	 * @brief Vrátí index úseku, který obsahuje daný cluster souboru, nebo getExtentCount(), pokud je cluster za koncem.
+	 */
+	size_t find(uint64_t logicalCluster) const
+	{
+		if (logicalCluster >= m_clusterCount)
+		{
+			return m_extents.size();
+		}
+
+		auto it = std::upper_bound(m_extents.begin(), m_extents.end(), logicalCluster,
+			[](uint64_t cluster, const Extent & extent)
+			{
+				return cluster < extent.logicalStart;
+			}
+		);
+
+		return static_cast<size_t>(std::distance(m_extents.begin(), it)) - 1;
+	}
+
+	/**
+	 * @brief Vrátí cluster na disku pro daný cluster souboru, nebo -1, pokud je cluster za koncem souboru.
+	 */
+	int64_t getPhysicalCluster(uint64_t logicalCluster) const
+	{
+		const size_t index = find(logicalCluster);
+		if (index >= m_extents.size())
+		{
+			return -1;
+		}
+
+		const Extent & extent = m_extents[index];
+
+		return extent.physicalStart + static_cast<int64_t>(logicalCluster - extent.logicalStart);
+	}
+
+	const Extent & operator[](size_t index) const
+	{
+		return m_extents[index];
+	}
+
+	size_t getExtentCount() const
+	{
+		return m_extents.size();
+	}
+
+	uint64_t getClusterCount() const
+	{
+		return m_clusterCount;
+	}
+
+	int64_t getLastCluster() const
+	{
+		if (m_extents.empty())
+		{
+			return -1;
+		}
+
+		const Extent & last = m_extents.back();
+
+		return last.physicalStart + static_cast<int64_t>(last.length) - 1;
+	}
+
+	bool isValidFor(int64_t owner, uint64_t version) const
+	{
+		return m_isValid && m_owner == owner && m_version == version;
+	}
+
+	void setValidFor(int64_t owner, uint64_t version)
+	{
+		m_owner = owner;
+		m_version = version;
+		m_isValid = true;
+	}
+
+	void invalidate()
+	{
+		m_isValid = false;
+	}
+};
@@ -1,31 +1,15 @@
+#include <algorithm>
+
 #include "fat.h"
+#include "fat_directory_index.h"
+#include "kernel.h"
 #include "util.h"
 
 #define VOLUME_DESCRIPTION "KIV/OS volume."
 #define SIGNATURE          "kiv-os"
 
-class Chunk
-{
-	int32_t m_start;
-	int32_t m_size;
-
-public:
-	Chunk(int32_t start, int32_t size)
-	: m_start(start),
-	  m_size(size)
-	{
-	}
-
-	int32_t getStart() const
-	{
-		return m_start;
-	}
-
-	int32_t getSize() const
-	{
-		return m_size;
-	}
-};
+// velikost bufferu s nulami v clusterech, vetsi useky nul se zapisuji opakovane z tohoto bufferu
+#define ZERO_FILL_CLUSTERS  64
 
 namespace
 {
@@ -40,347 +24,360 @@ namespace
 		return Util::DivCeil(sector, bootRecord.bytes_per_sector);
 	}
 
-	/**
-	 * Returns the first unused cluster found or NO_CLUSTER.
-	 */
-	inline int32_t GetFreeCluster(const int32_t *fat, int32_t fatSize)
+	inline size_t BytesPerCluster(const FAT::BootRecord & bootRecord)
 	{
-		int32_t result = NO_CLUSTER;
-
-		for (int32_t i = 0; i < fatSize; i++)
-		{
-			if (fat[i] == FAT_UNUSED)
-			{
-				result = i;
-				break;
-			}
-		}
+		return bootRecord.bytes_per_sector * bootRecord.cluster_size;
+	}
 
-		return result;
+	inline size_t MaxItemsInDir(size_t dirSizeBytes)
+	{
+		return dirSizeBytes / sizeof (FAT::Directory);
 	}
 
 	/**
-	 * @brief Prevede logicky cluster (poradove cislo) souboru na realny.
-	 * Pokud je logCluster vetsi nez relany pocet souboru clusteru, bude vracen posledni.
+	 * @biref Alokuje zadany pocet clusteru ve FAT od zadaneho poledniho clusteru.
+	 * Clustery se berou po celych souvislych usecich. Prednostne se pouzije volne misto hned za poslednim clusterem, jinak
+	 * nejmensi volny usek, do ktereho se vejde cely pozadavek. Soubor se tak rozdeli na co nejmene souvislych casti.
+	 * Tato funkce na nic nezapisuje, pouze modifikuje zadanou FAT. Pokud je zadana mapa useku souboru, nove clustery se do
+	 * ni pridaji.
 	 */
-	inline int32_t LogClusterToReal(const int32_t *fat, int32_t startCluster, int32_t logCluster)
+	inline EStatus AllocateClusters(FAT::Table & fatTable, int32_t lastCluster, size_t count, ExtentMap *pExtents = nullptr)
 	{
-		int32_t realCluster = startCluster;
-
-		for (int32_t i = 0; i < logCluster && fat[realCluster] != FAT_FILE_END; i++)
+		if (fatTable.getFreeCount() < count)
 		{
-			realCluster = fat[realCluster];
+			return EStatus::NOT_ENOUGH_DISK_SPACE;
 		}
 
-		return realCluster;
-	}
+		while (count > 0)
+		{
+			int32_t extentStart = NO_CLUSTER;
+			size_t extentLength = fatTable.findFreeExtent(count, lastCluster + 1, extentStart);
 
-	inline int32_t FindLastFileCluster(const int32_t *fat, int32_t startCluster)
-	{
-		int32_t lastCluster = startCluster;
+			if (extentLength > count)
+			{
+				extentLength = count;
+			}
 
-		while (fat[lastCluster] != FAT_FILE_END)
-		{
-			lastCluster = fat[lastCluster];
+			for (size_t i = 0; i < extentLength; i++)
+			{
+				const int32_t nextCluster = extentStart + static_cast<int32_t>(i);
+
+				fatTable.set(nextCluster, FAT_FILE_END);
+				fatTable.set(lastCluster, nextCluster);
+				lastCluster = nextCluster;
+			}
+
+			if (pExtents)
+			{
+				pExtents->append(extentStart, extentLength);
+			}
+
+			count -= extentLength;
 		}
 
-		return lastCluster;
+		return EStatus::SUCCESS;
 	}
 
-	inline size_t BytesPerCluster(const FAT::BootRecord & bootRecord)
+	/**
+	 * @brief Precte sektory z disku pres cache sektoru do bufferu.
+	 * @return
+	 *  EStatus::SUCCESS Pokud nacteni probehne v poradku.
+	 */
+	inline EStatus ReadFromDisk(uint8_t diskNumber, uint64_t startSector, uint64_t sectorCount, char *buffer)
 	{
-		return bootRecord.bytes_per_sector * bootRecord.cluster_size;
+		return Kernel::GetBlockCache().read(diskNumber, startSector, sectorCount, buffer);
 	}
 
-	inline size_t CountFileClusters(const int32_t *fat, int32_t startCluster)
+	/**
+	 * @brief Zapise sektory z bufferu na disk pres cache sektoru.
+	 * Male zapisy zustanou v cache, dokud je nezapise BlockCache::flush.
+	 * @return
+	 *  EStatus::SUCCESS Pokud zapis probehne v poradku.
+	 */
+	inline EStatus WriteToDisk(uint8_t diskNumber, uint64_t startSector, uint64_t sectorCount, const char *buffer)
 	{
-		size_t count = 1;
+		return Kernel::GetBlockCache().write(diskNumber, startSector, sectorCount, buffer);
+	}
 
-		for (int32_t cluster = startCluster; fat[cluster] != FAT_FILE_END; cluster = fat[cluster])
+	/**
+	 * @brief Precte nebo zapise vsechny useky sektoru jednim volanim cache sektoru.
+	 * Velke useky se tak na disk dostanou jednim volanim BIOSu, i kdyz soubor neni souvisly.
+	 */
+	inline EStatus TransferSegments(uint8_t diskNumber, const std::vector<BlockCache::Segment> & segments, bool isWrite)
+	{
+		if (segments.empty())
 		{
-			count++;
+			return EStatus::SUCCESS;
 		}
 
-		return count;
+		BlockCache & blockCache = Kernel::GetBlockCache();
+
+		return (isWrite) ? blockCache.writeSegments(diskNumber, segments) : blockCache.readSegments(diskNumber, segments);
 	}
 
-	/**
-	 * @brief Vrati pocet volnych clusteru ve FAT.
-	 */
-	inline size_t CountFreeClusters(const int32_t *fat, size_t fatLength)
-	{
-		size_t count = 0;
+	// buffer pro castecne ctene clustery, kazde vlakno ma vlastni
+	thread_local std::vector<char> g_bounceBuffer;
 
-		for (size_t i = 0; i < fatLength; i++)
+	inline char *GetBounceBuffer(size_t size)
+	{
+		if (g_bounceBuffer.size() < size)
 		{
-			if (fat[i] == FAT_UNUSED)
-			{
-				count++;
-			}
+			g_bounceBuffer.resize(size);
 		}
 
-		return count;
+		return g_bounceBuffer.data();
 	}
 
-	inline size_t MaxItemsInDir(size_t dirSizeBytes)
+	inline uint64_t ClusterToSector(const FAT::BootRecord & bootRecord, uint64_t cluster)
 	{
-		return dirSizeBytes / sizeof (FAT::Directory);
+		return FirstDataSector(bootRecord) + cluster * bootRecord.cluster_size;
 	}
 
 	/**
-	 * @biref Alokuje zadany pocet clusteru ve FAT od zadaneho poledniho clusteru.
-	 * Tato funkce na nic nezapisuje, pouze modifikuje zadanou FAT.
+	 * @brief Precte zadany souvisly rozsah clusteru do bufferu.
+	 * Cele clustery se ctou primo do bufferu. Pres pomocny buffer vlakna se ctou jen castecne ctene clustery na zacatku
+	 * a na konci rozsahu.
+	 *
+	 * @param bufferSize Maximalni pocet bytu ktery nacist do bufferu.
+	 * @param offset Offset v bytech od zacatku prvniho clusteru, od ktereho se cte.
+	 * @param pSegments Pokud je zadany, cele clustery se do nej jen pridaji jako usek a prectou se az pozdeji spolu
+	 * s ostatnimi useky.
 	 */
-	inline EStatus AllocateClusters(const FAT::BootRecord & bootRecord, int32_t *fatTable, int32_t lastCluster, size_t count)
+	inline EStatus ReadClusterRange(uint8_t diskNumber, const FAT::BootRecord & bootRecord, int32_t cluster,
+	                                uint32_t clusterCount, char *buffer, size_t bufferSize, size_t offset,
+	                                std::vector<BlockCache::Segment> *pSegments = nullptr)
 	{
-		const size_t freeClusters = CountFreeClusters(fatTable, bootRecord.usable_cluster_count);
+		const size_t bytesPerCluster = BytesPerCluster(bootRecord);
+		const size_t rangeSize = static_cast<size_t>(clusterCount) * bytesPerCluster;
 
-		if (freeClusters < count)
+		if (offset >= rangeSize)
 		{
-			return EStatus::NOT_ENOUGH_DISK_SPACE;
+			return EStatus::SUCCESS;
 		}
 
-		if (count == 0)
+		if (bufferSize > rangeSize - offset)
 		{
-			return EStatus::SUCCESS;
+			bufferSize = rangeSize - offset;
 		}
 
-		int32_t nextCluster = 0;
+		uint64_t currentCluster = static_cast<uint64_t>(cluster) + offset / bytesPerCluster;
+		size_t pos = offset % bytesPerCluster;
+		size_t done = 0;
+
+		EStatus status;
 
-		for (size_t i = 0; i < count; i++)
+		// zacatek uprostred clusteru
+		if (pos != 0 || bufferSize < bytesPerCluster)
 		{
-			nextCluster = GetFreeCluster(fatTable, bootRecord.usable_cluster_count);
-			fatTable[lastCluster] = nextCluster;
-			fatTable[nextCluster] = FAT_FILE_END;
-			lastCluster = nextCluster;
-		}
+			const size_t partSize = std::min(bytesPerCluster - pos, bufferSize);
+			char *bounceBuffer = GetBounceBuffer(bytesPerCluster);
 
-		return EStatus::SUCCESS;
-	}
+			status = ReadFromDisk(diskNumber, ClusterToSector(bootRecord, currentCluster), bootRecord.cluster_size,
+			                      bounceBuffer);
+			if (status != EStatus::SUCCESS)
+			{
+				return status;
+			}
 
-	/**
-	 * @brief Rozdeli dany soubor na souvisle useky clusteru (startCluster + pocet souvislych clusteru).
-	 * Funguje i pro adresare. Max velikost chunku je 1000.
-	 */
-	inline void SplitFileToChunks(const int32_t *fatTable, int32_t startCluster, std::vector<Chunk> & chunks)
-	{
-		int32_t currentCluster = startCluster;
-		int32_t previousCluster = startCluster;
-		int32_t chunkStart = startCluster;
-		int32_t chunkSize = 1;
+			std::memcpy(buffer, bounceBuffer + pos, partSize);
 
-		while (currentCluster != FAT_FILE_END)
+			done += partSize;
+			currentCluster++;
+		}
+
+		// cele clustery primo do ciloveho bufferu
+		const size_t fullClusters = (bufferSize - done) / bytesPerCluster;
+
+		if (fullClusters > 0)
 		{
-			currentCluster = fatTable[currentCluster];
+			const uint64_t startSector = ClusterToSector(bootRecord, currentCluster);
+			const uint64_t sectorCount = static_cast<uint64_t>(fullClusters) * bootRecord.cluster_size;
 
-			if ((currentCluster - previousCluster) == 1 && chunkSize != 1000)
+			if (pSegments)
 			{
-				// predchozi cluster je tesne pred soucasnym, pokracuj v chunku
-				chunkSize++;
+				pSegments->push_back({ startSector, sectorCount, buffer + done });
 			}
 			else
 			{
-				// predchozi cluster je jinde v pameti
-				chunks.emplace_back(chunkStart, chunkSize);
-				chunkStart = currentCluster;
-				chunkSize = 1;
+				status = ReadFromDisk(diskNumber, startSector, sectorCount, buffer + done);
+				if (status != EStatus::SUCCESS)
+				{
+					return status;
+				}
 			}
 
-			previousCluster = currentCluster;
+			done += fullClusters * bytesPerCluster;
+			currentCluster += fullClusters;
 		}
-	}
 
-	/**
-	 * @brief Vrati cislo clusteru ve kterem se nachazi dany offset.
-	 */
-	inline int32_t GetClusterByOffset(const int32_t *fatTable, int32_t startCluster, size_t offset, size_t clusterSize)
-	{
-		if (offset == 0)
+		// konec uprostred clusteru
+		if (done < bufferSize)
 		{
-			return startCluster;
-		}
+			char *bounceBuffer = GetBounceBuffer(bytesPerCluster);
 
-		// kolikaty logicky cluster hledame
-		size_t clusterNumber = offset / clusterSize;
-		int32_t cluster = startCluster;
+			status = ReadFromDisk(diskNumber, ClusterToSector(bootRecord, currentCluster), bootRecord.cluster_size,
+			                      bounceBuffer);
+			if (status != EStatus::SUCCESS)
+			{
+				return status;
+			}
 
-		while (clusterNumber > 0 && cluster != FAT_FILE_END)
-		{
-			cluster = fatTable[cluster];
-			clusterNumber--;
+			std::memcpy(buffer + done, bounceBuffer, bufferSize - done);
 		}
 
-		return cluster;
+		return EStatus::SUCCESS;
 	}
 
-	inline FAT::Directory *GetDirectoryItem(const std::string & name, std::vector<FAT::Directory> & items)
+	/**
+	 * @brief Zapise dany pocet clusteru z bufferu na disk.
+	 * Predpoklada se, ze velikost buffer je >= poctu zapisovanych bytu.
+	 */
+	inline EStatus WriteClusterRange(uint8_t diskNumber, const FAT::BootRecord & bootRecord,
+	                                 int32_t cluster, uint32_t clusterCount, const char *buffer)
 	{
-		for (FAT::Directory & item : items)
-		{
-			if (name.compare(item.name) == 0)
-			{
-				return &item;
-			}
-		}
+		uint64_t startSector = ClusterToSector(bootRecord, cluster);
+		uint64_t sectorCount = clusterCount * bootRecord.cluster_size;
 
-		return nullptr;
+		return WriteToDisk(diskNumber, startSector, sectorCount, buffer);
 	}
 
 	/**
-	 * @brief Zavola sluzbu BIOSu pro cteni z disku a data ulozi do buffer.
-	 * @return
-	 *  EStatus::SUCCESS Pokud nacteni probehne v poradku.
+	 * @brief Zapise data do souboru od zadaneho offsetu.
+	 * Soubor uz musi mit alokovane vsechny clustery, do kterych se zapisuje. Castecne zapisovane clustery se nejdriv
+	 * prectou a zapisou hned. Cele clustery se zapisuji po souvislych usecich a vsechny useky se predaji na disk najednou.
+	 *
+	 * @param data Zapisovana data nebo nullptr, pokud se maji zapsat nuly.
 	 */
-	inline EStatus ReadFromDisk(uint8_t diskNumber, uint64_t startSector, uint64_t sectorCount, char *buffer)
+	inline EStatus WriteFileRange(uint8_t diskNumber, const FAT::BootRecord & bootRecord, const ExtentMap & extents,
+	                              uint64_t offset, const char *data, size_t length)
 	{
-		kiv_hal::TRegisters registers;
-		kiv_hal::TDisk_Address_Packet addressPacket;
+		const size_t bytesPerCluster = BytesPerCluster(bootRecord);
 
-		addressPacket.lba_index = startSector;  // zacni na sektoru
-		addressPacket.count = sectorCount;      // precti x sektoru
-		addressPacket.sectors = buffer;         // data prenacti do bufferu
+		std::vector<char> clusterBuffer;
+		std::vector<char> zeroBuffer;
+		std::vector<BlockCache::Segment> segments;
 
-		registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Read_Sectors);  // jakou operaci nad diskem provest
-		registers.rdi.r = reinterpret_cast<uint64_t>(&addressPacket);             // info pro cteni dat
-		registers.rdx.l = diskNumber;                                             // cislo disku ze ktereho cist
+		uint64_t logicalCluster = offset / bytesPerCluster;
+		size_t pos = static_cast<size_t>(offset % bytesPerCluster);
+		size_t index = extents.find(logicalCluster);
+		size_t written = 0;
 
-		kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
-
-		if (registers.flags.carry)
+		while (written < length)
 		{
-			// chyba pri cteni z disku
-			return EStatus::IO_ERROR;
-		}
+			if (index >= extents.getExtentCount())
+			{
+				// soubor nema dost alokovanych clusteru
+				return EStatus::IO_ERROR;
+			}
 
-		return EStatus::SUCCESS;
-	}
+			const ExtentMap::Extent & extent = extents[index];
+			const uint64_t skip = logicalCluster - extent.logicalStart;
+			const int32_t cluster = static_cast<int32_t>(extent.physicalStart + skip);
+			const size_t remaining = length - written;
 
-	/**
-	 * @brief Zavola sluzbu BIOSu pro zapis dat z bufferu na disk.
-	 * @return
-	 *  EStatus::SUCCESS Pokud zapis probehne v poradku.
-	 */
-	inline EStatus WriteToDisk(uint8_t diskNumber, uint64_t startSector, uint64_t sectorCount, const char *buffer)
-	{
-		kiv_hal::TRegisters registers;
-		kiv_hal::TDisk_Address_Packet addressPacket;
+			EStatus status;
 
-		addressPacket.lba_index = startSector;              // zacni na sektoru
-		addressPacket.count = sectorCount;                  // zapis x sektoru
-		addressPacket.sectors = const_cast<char*>(buffer);  // data pro zapis
+			if (pos != 0 || remaining < bytesPerCluster)
+			{
+				// zapis jen casti clusteru
+				const size_t partSize = std::min(bytesPerCluster - pos, remaining);
 
-		registers.rax.h = static_cast<uint8_t>(kiv_hal::NDisk_IO::Write_Sectors);  // jakou operaci nad diskem provest
-		registers.rdi.r = reinterpret_cast<uint64_t>(&addressPacket);              // info pro cteni dat
-		registers.rdx.l = diskNumber;                                              // cislo disku ze ktereho cist
+				clusterBuffer.resize(bytesPerCluster);
 
-		kiv_hal::Call_Interrupt_Handler(kiv_hal::NInterrupt::Disk_IO, registers);
+				status = ReadClusterRange(diskNumber, bootRecord, cluster, 1, clusterBuffer.data(), bytesPerCluster, 0);
+				if (status != EStatus::SUCCESS)
+				{
+					return status;
+				}
 
-		if (registers.flags.carry)
-		{
-			kiv_hal::NDisk_Status error = static_cast<kiv_hal::NDisk_Status>(registers.rax.x);
+				if (data)
+				{
+					std::memcpy(clusterBuffer.data() + pos, data + written, partSize);
+				}
+				else
+				{
+					std::memset(clusterBuffer.data() + pos, 0, partSize);
+				}
 
-			if (error == kiv_hal::NDisk_Status::Fixed_Disk_Write_Fault_On_Selected_Drive)
-			{
-				// disk je pouze pro cteni
-				return EStatus::PERMISSION_DENIED;
+				status = WriteClusterRange(diskNumber, bootRecord, cluster, 1, clusterBuffer.data());
+				if (status != EStatus::SUCCESS)
+				{
+					return status;
+				}
+
+				written += partSize;
+				logicalCluster++;
+				pos = 0;
 			}
 			else
 			{
-				// chyba pri cteni z disku
-				return EStatus::IO_ERROR;
-			}
-		}
-
-		return EStatus::SUCCESS;
-	}
-
-	/**
-	 * @brief Precte zadany souvisly rozsah clusteru do bufferu.
-	 *
-	 * @param bufferSize Maximalni pocet bytu ktery nacist do bufferu. Relevantni jen pokud je tento pocet mensi nez pocet
-	 * clusteru * velikost clusteru.
-	 */
-	inline EStatus ReadClusterRange(uint8_t diskNumber, const FAT::BootRecord & bootRecord, int32_t cluster,
-	                                uint32_t clusterCount, char *buffer, size_t bufferSize, size_t offset)
-	{
-		uint64_t startSector = FirstDataSector(bootRecord) + cluster * bootRecord.cluster_size;
-		uint64_t sectorCount = clusterCount * bootRecord.cluster_size;
-		size_t sectorBufferSize = static_cast<size_t>(sectorCount) * bootRecord.bytes_per_sector;
+				// cele clustery ze souvisleho useku najednou
+				uint64_t clusterCount = std::min<uint64_t>(extent.length - skip, remaining / bytesPerCluster);
 
-		if (offset > sectorBufferSize)
-		{
-			return EStatus::SUCCESS;
-		}
+				if (!data && clusterCount > ZERO_FILL_CLUSTERS)
+				{
+					// nuly se zapisuji ze spolecneho bufferu, ktery nemusi pokryt cely usek
+					clusterCount = ZERO_FILL_CLUSTERS;
+				}
 
-		std::vector<char> sectorBuffer;
-		sectorBuffer.resize(sectorBufferSize, 0);
+				const size_t rangeSize = static_cast<size_t>(clusterCount) * bytesPerCluster;
+				char *rangeData;
 
-		// nacti sektory obsahujici 1 cluster do sectorBufferu
-		EStatus status = ReadFromDisk(diskNumber, startSector, sectorCount, sectorBuffer.data());
-		if (status != EStatus::SUCCESS)
-		{
-			// chyba pri cteni z disku
-			return status;
-		}
+				if (data)
+				{
+					rangeData = const_cast<char*>(data + written);
+				}
+				else
+				{
+					if (zeroBuffer.empty())
+					{
+						zeroBuffer.assign(ZERO_FILL_CLUSTERS * bytesPerCluster, 0);
+					}
 
-		// ze sectorBufferu nacti cluster do bufferu
-		// pokud uz je cilovy buffer plny a cely cluster se do nej nevejde,
-		// nacti jen to co muzes
-		if (sectorBufferSize < bufferSize)
-		{
-			sectorBufferSize = bufferSize;
-		}
-		else if (bufferSize > 0 && (sectorBufferSize - offset) > bufferSize) {
-			sectorBufferSize = bufferSize + offset;
-		}
+					rangeData = zeroBuffer.data();
+				}
 
-		std::memcpy(buffer, sectorBuffer.data() + offset, sectorBufferSize - offset);
+				segments.push_back({ ClusterToSector(bootRecord, cluster), clusterCount * bootRecord.cluster_size,
+				                     rangeData });
 
-		return EStatus::SUCCESS;
-	}
+				written += rangeSize;
+				logicalCluster += clusterCount;
+			}
 
-	/**
-	 * @brief Zapise dany pocet clusteru z bufferu na disk.
-	 * Predpoklada se, ze velikost buffer je >= poctu zapisovanych bytu.
-	 */
-	inline EStatus WriteClusterRange(uint8_t diskNumber, const FAT::BootRecord & bootRecord,
-	                                 int32_t cluster, uint32_t clusterCount, const char *buffer)
-	{
-		uint64_t startSector = FirstDataSector(bootRecord) + cluster * bootRecord.cluster_size;
-		uint64_t sectorCount = clusterCount * bootRecord.cluster_size;
+			if (logicalCluster >= extent.logicalStart + extent.length)
+			{
+				index++;
+			}
+		}
 
-		return WriteToDisk(diskNumber, startSector, sectorCount, buffer);
+		return TransferSegments(diskNumber, segments, true);
 	}
 
 	/**
-	 * @brief Ulozi bootRecord, FAT a pripadne kopie.
+	 * @brief Zapise na disk cluster (pripadne oba clustery), ve kterem lezi polozka adresare na dane pozici.
 	 */
-	inline EStatus UpdateFAT(uint8_t diskNumber, const FAT::BootRecord & bootRecord, const int32_t *fat)
+	inline EStatus WriteDirectorySlot(uint8_t diskNumber, const FAT::BootRecord & bootRecord,
+	                                  const FAT::DirectoryIndex & index, size_t slot)
 	{
-		// zapiseme br, fat i jeji kopie najednou
-		// pokud to bude mnoc pameti,
-		// muzeme zmenit na postupne zapisovani (treba po 1 kb)
-		const size_t fatSize = bootRecord.usable_cluster_count;
-		const uint64_t sectorCount = FirstDataSector(bootRecord);
-		const size_t bufferSize = static_cast<size_t>(sectorCount) * bootRecord.bytes_per_sector;
+		const size_t clusterSize = BytesPerCluster(bootRecord);
+		const size_t offset = slot * sizeof (FAT::Directory);
 
-		std::vector<char> buffer;
-		buffer.resize(bufferSize, 0);
+		// polozka muze zasahovat do dvou clusteru
+		const uint64_t c1 = offset / clusterSize;
+		const uint64_t c2 = (offset + sizeof (FAT::Directory) - 1) / clusterSize;
 
-		// boot record
-		std::memcpy(buffer.data(), &bootRecord, sizeof (FAT::BootRecord));
-		size_t bufferPointer = sizeof (FAT::BootRecord);
-
-		// fat and copies
-		for (size_t i = 0; i < bootRecord.fat_copies; i++)
+		for (uint64_t c = c1; c <= c2; c++)
 		{
-			bufferPointer += i * fatSize * sizeof (int32_t);
-			std::memcpy(buffer.data() + bufferPointer, fat, fatSize * sizeof (int32_t));
-		}
+			const int32_t realCluster = static_cast<int32_t>(index.getExtents().getPhysicalCluster(c));
 
-		EStatus status = WriteToDisk(diskNumber, 0, sectorCount, buffer.data());
+			EStatus status = WriteClusterRange(diskNumber, bootRecord, realCluster, 1, index.data() + (c * clusterSize));
+			if (status != EStatus::SUCCESS)
+			{
+				return status;
+			}
+		}
 
-		return status;
+		return EStatus::SUCCESS;
 	}
 }
 
@@ -488,8 +485,10 @@ EStatus FAT::Init(uint8_t diskNumber, const kiv_hal::TDrive_Parameters & diskPar
 }
 
 EStatus FAT::Load(uint8_t diskNumber, const kiv_hal::TDrive_Parameters & diskParams,
-                  BootRecord & bootRecord, std::vector<int32_t> & fatTable)
+                  BootRecord & bootRecord, Table & table)
 {
+	std::vector<int32_t> fatTable;
+
 	// kolik sektoru nacist
 	const uint64_t sectorCount = Util::DivCeil(ALIGNED_BOOT_REC_SIZE, diskParams.bytes_per_sector);
 
@@ -538,11 +537,71 @@ EStatus FAT::Load(uint8_t diskNumber, const kiv_hal::TDrive_Parameters & diskPar
 	// odstranime sektorove zarovnani na konci
 	fatTable.resize(bootRecord.usable_cluster_count, 0);
 
+	table.assign(std::move(fatTable), ALIGNED_BOOT_REC_SIZE, bootRecord.bytes_per_sector, bootRecord.fat_copies);
+
 	return EStatus::SUCCESS;
 }
 
-EStatus FAT::ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
-                           const Directory & directory, std::vector<Directory> & result)
+EStatus FAT::Flush(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable)
+{
+	const std::set<uint64_t> & dirtySectors = fatTable.getDirtySectors();
+	const size_t bytesPerSector = bootRecord.bytes_per_sector;
+
+	std::vector<char> buffer;
+
+	auto it = dirtySectors.begin();
+
+	while (it != dirtySectors.end())
+	{
+		// najdi souvisly usek zmenenych sektoru, ktery lze zapsat najednou
+		const uint64_t firstSector = *it;
+		uint64_t sectorCount = 1;
+
+		for (++it; it != dirtySectors.end() && *it == firstSector + sectorCount; ++it)
+		{
+			sectorCount++;
+		}
+
+		const uint64_t diskOffset = firstSector * bytesPerSector;
+
+		buffer.clear();
+		buffer.resize(static_cast<size_t>(sectorCount) * bytesPerSector, 0);
+
+		// sektor muze obsahovat i cast boot recordu
+		if (diskOffset < sizeof (BootRecord))
+		{
+			const size_t length = std::min(sizeof (BootRecord) - static_cast<size_t>(diskOffset), buffer.size());
+
+			std::memcpy(buffer.data(), reinterpret_cast<const char*>(&bootRecord) + diskOffset, length);
+		}
+
+		fatTable.copyToDiskRange(diskOffset, buffer.size(), buffer.data());
+
+		EStatus status = WriteToDisk(diskNumber, firstSector, sectorCount, buffer.data());
+		if (status != EStatus::SUCCESS)
+		{
+			// zmenene sektory zustanou oznacene a zapisou se pri dalsim pokusu
+			return status;
+		}
+	}
+
+	fatTable.clearDirty();
+
+	return EStatus::SUCCESS;
+}
+
+void FAT::BuildExtentMap(const Table & fatTable, int32_t startCluster, ExtentMap & extents)
+{
+	extents.clear();
+
+	for (int32_t cluster = startCluster; cluster != FAT_FILE_END; cluster = fatTable[cluster])
+	{
+		extents.append(cluster, 1);
+	}
+}
+
+EStatus FAT::LoadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+                           const Directory & directory, DirectoryIndex & index, const ExtentMap *pExtents)
 {
 	// kontrola, ze je vazne potreba cokoliv delat
 	if (!directory.isDirectory())
@@ -550,9 +609,18 @@ EStatus FAT::ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, co
 		return EStatus::INVALID_ARGUMENT;
 	}
 
-	const size_t dirClusterCount = CountFileClusters(fatTable, directory.start_cluster);
-	const size_t bufferSize = dirClusterCount * bootRecord.bytes_per_sector * bootRecord.cluster_size;
-	const size_t dirItemCount = bufferSize / sizeof (Directory);
+	ExtentMap extents;
+
+	if (pExtents)
+	{
+		extents = *pExtents;
+	}
+	else
+	{
+		BuildExtentMap(fatTable, directory.start_cluster, extents);
+	}
+
+	const size_t bufferSize = static_cast<size_t>(extents.getClusterCount()) * BytesPerCluster(bootRecord);
 
 	std::vector<char> buffer;
 	buffer.resize(bufferSize, 0);
@@ -560,31 +628,42 @@ EStatus FAT::ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, co
 	size_t bytesRead = 0;
 
 	// nactu cely soubor s adresarem
-	EStatus status = ReadFile(diskNumber, bootRecord, fatTable, directory, buffer.data(), buffer.size(), bytesRead, 0);
+	EStatus status = ReadFile(diskNumber, bootRecord, fatTable, directory, buffer.data(), buffer.size(), bytesRead, 0,
+	                          &extents);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
-	// zkopirovani itemu v adresari do dirItems
-	Directory *dirItems = reinterpret_cast<Directory*>(buffer.data());
+	index.assign(std::move(buffer), std::move(extents));
 
-	result.reserve(dirItemCount);
+	return EStatus::SUCCESS;
+}
+
+EStatus FAT::ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+                           const Directory & directory, std::vector<Directory> & result, const DirectoryIndex *pIndex)
+{
+	DirectoryIndex index;
 
-	for (size_t i = 0; i < dirItemCount; i++)
+	if (!pIndex)
 	{
-		// vyber neprazdne polozky
-		if (dirItems[i].hasName())
+		EStatus status = LoadDirectory(diskNumber, bootRecord, fatTable, directory, index);
+		if (status != EStatus::SUCCESS)
 		{
-			result.emplace_back(dirItems[i]);
-		} 
+			return status;
+		}
+
+		pIndex = &index;
 	}
 
+	// vyber neprazdne polozky
+	pIndex->getItems(result);
+
 	return EStatus::SUCCESS;
 }
 
-EStatus FAT::ReadFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable, const Directory & file,
-                      char *buffer, size_t bufferSize, size_t & bytesRead, uint64_t offset)
+EStatus FAT::ReadFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable, const Directory & file,
+                      char *buffer, size_t bufferSize, size_t & bytesRead, uint64_t offset, const ExtentMap *pExtents)
 {
 	bytesRead = 0;
 
@@ -594,66 +673,92 @@ EStatus FAT::ReadFile(uint8_t diskNumber, const BootRecord & bootRecord, const i
 		return EStatus::SUCCESS;
 	}
 
+	ExtentMap fileExtents;
+
+	if (!pExtents)
+	{
+		BuildExtentMap(fatTable, file.start_cluster, fileExtents);
+		pExtents = &fileExtents;
+	}
+
+	const ExtentMap & extents = *pExtents;
 	const size_t bytesPerCluster = BytesPerCluster(bootRecord);
 
-	// od ktere casti ktereho clusteru budeme cist
-	int32_t currentCluster = GetClusterByOffset(fatTable, file.start_cluster, static_cast<size_t>(offset), bytesPerCluster);
-	if (currentCluster == FAT_FILE_END)
+	// adresare maji velikost 0 a ctou se cele
+	const uint64_t fileSize = (file.isDirectory()) ? extents.getClusterCount() * bytesPerCluster : file.size;
+
+	if (offset >= fileSize)
 	{
 		// offset je za koncem souboru => neni co cist
 		return EStatus::SUCCESS;
 	}
 
-	size_t pos = offset % bytesPerCluster;
-	size_t bytesToRead = bytesPerCluster - pos;
-
-	std::vector<Chunk> chunks;
+	size_t bytesToRead = bufferSize;
+	if (bytesToRead > fileSize - offset)
+	{
+		bytesToRead = static_cast<size_t>(fileSize - offset);
+	}
 
-	// rozdelit zbytek soubor na chunky
-	SplitFileToChunks(fatTable, currentCluster, chunks);
+	// od ktere casti ktereho clusteru budeme cist
+	uint64_t logicalCluster = offset / bytesPerCluster;
+	size_t pos = static_cast<size_t>(offset % bytesPerCluster);
+	size_t index = extents.find(logicalCluster);
 
-	bool isBufferFull = false;
+	// cele clustery vsech souvislych useku se prectou najednou az na konci
+	std::vector<BlockCache::Segment> segments;
+	size_t done = 0;
 
-	// ted nacitej po clusterech
-	for (size_t i = 0; i < chunks.size() && !isBufferFull; i++)
+	// cti po souvislych usecich clusteru
+	while (done < bytesToRead && index < extents.getExtentCount())
 	{
-		// pokud uz je cilovy buffer plny a cely cluster se do nej nevejde,
-		// nebo jsme precetli cely soubor
-		// nacti jen to co muzes
-		bytesToRead = chunks[i].getSize() * bytesPerCluster - pos;
+		const ExtentMap::Extent & extent = extents[index];
+		const uint64_t skip = logicalCluster - extent.logicalStart;
 
-		if (bytesRead + bytesToRead > bufferSize)
-		{
-			bytesToRead = bufferSize - bytesRead;
-			isBufferFull = true;
-		}
-		else if (bytesRead + bytesToRead > file.size)
+		uint64_t clusterCount = extent.length - skip;
+
+		size_t length = static_cast<size_t>(clusterCount) * bytesPerCluster - pos;
+		if (length > bytesToRead - done)
 		{
-			bytesToRead = file.size - bytesRead;
-			isBufferFull = true;
+			// nacti jen to co je potreba
+			length = bytesToRead - done;
+			clusterCount = Util::DivCeil(pos + length, bytesPerCluster);
 		}
 
-		int32_t cluster = chunks[i].getStart();
-		uint32_t count = static_cast<uint32_t>(chunks[i].getSize());
+		const int32_t cluster = static_cast<int32_t>(extent.physicalStart + skip);
+		const uint32_t count = static_cast<uint32_t>(clusterCount);
 
-		// nacti chunk do bufferu
-		EStatus status = ReadClusterRange(diskNumber, bootRecord, cluster, count, buffer + bytesRead, bytesToRead, pos);
+		EStatus status = ReadClusterRange(diskNumber, bootRecord, cluster, count, buffer + done, length, pos, &segments);
 		if (status != EStatus::SUCCESS)
 		{
-			break;
+			return status;
 		}
 
-		bytesRead += bytesToRead;
+		done += length;
+		logicalCluster += clusterCount;
 
-		// s offsetem cteme jen pri ctnei prvniho clusteru
+		// s offsetem cteme jen pri cteni prvniho clusteru
 		pos = 0;
+
+		if (logicalCluster >= extent.logicalStart + extent.length)
+		{
+			index++;
+		}
+	}
+
+	EStatus status = TransferSegments(diskNumber, segments, false);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
 	}
 
+	bytesRead = done;
+
 	return EStatus::SUCCESS;
 }
 
-EStatus FAT::WriteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable, Directory & file,
-                       const char *buffer, size_t bufferSize, size_t & bytesWritten, uint64_t offset)
+EStatus FAT::WriteFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable, Directory & file,
+                       const char *buffer, size_t bufferSize, size_t & bytesWritten, uint64_t offset,
+                       ExtentMap *pExtents)
 {
 	bytesWritten = 0;
 
@@ -667,162 +772,72 @@ EStatus FAT::WriteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_
 		return EStatus::SUCCESS;
 	}
 
-	const int32_t lastFileCluster = FindLastFileCluster(fatTable, file.start_cluster);
-	const size_t fileClusterCount = CountFileClusters(fatTable, file.start_cluster);
-	const size_t clusterSize = BytesPerCluster(bootRecord);
-
-	std::vector<char> clusterBuffer;
-	clusterBuffer.resize(clusterSize, 0);
-
-	size_t fillBytes = 0;
-	size_t newBytes = 0;
-	size_t bytesToWrite = 0;
-
-	// misto ktere uz je pro soubor alokovane
-	const size_t allocatedSize = fileClusterCount * clusterSize;
+	const uint64_t endOffset = offset + bufferSize;
 
-	if ((offset + bufferSize) > allocatedSize)
+	if (endOffset > UINT32_MAX)
 	{
-		// zapisovana data presahnou velikost souboru
-		if (offset > allocatedSize)
-		{
-			// offset je za koncem souboru
-			// musime alokovat misto na 0 a na data
-			fillBytes = static_cast<size_t>(offset) - allocatedSize;
-			newBytes = fillBytes + bufferSize;
-		}
-		else
-		{
-			// offset je pred koncem souboru, ale data presahnou konec souboru
-			// musime alokovat clustery na data
-			newBytes = bufferSize - (allocatedSize - static_cast<size_t>(offset));
-		}
+		// velikost souboru se do polozky v adresari nevejde
+		return EStatus::NOT_ENOUGH_DISK_SPACE;
 	}
 
-	// kolik clusteru musime alokovat pro data?
-	size_t clustersToAllocate = static_cast<size_t>(Util::DivCeil(newBytes, clusterSize));
+	ExtentMap fileExtents;
 
-	EStatus status = AllocateClusters(bootRecord, fatTable, lastFileCluster, clustersToAllocate);
-	if (status != EStatus::SUCCESS)
+	if (!pExtents)
 	{
-		return status;
+		BuildExtentMap(fatTable, file.start_cluster, fileExtents);
+		pExtents = &fileExtents;
 	}
 
-	int32_t currentCluster = 0;
-
-	// od ktereho clsuteru budeme zapisovat
-	if (fillBytes > 0)
-	{
-		// budeme zapisovat vyplnove byty -> zacneme na konci soucasneho souboru
-		currentCluster = GetClusterByOffset(fatTable, file.start_cluster, allocatedSize, clusterSize);
-	}
-	else
-	{
-		currentCluster = GetClusterByOffset(fatTable, file.start_cluster, static_cast<size_t>(offset), clusterSize);
-	}
+	ExtentMap & extents = *pExtents;
+	const size_t bytesPerCluster = BytesPerCluster(bootRecord);
 
-	size_t writtenBytes = 0;
+	// kolik clusteru musime alokovat pro data?
+	const uint64_t requiredClusterCount = Util::DivCeil(endOffset, bytesPerCluster);
 
-	// zapis fill byty
-	while (writtenBytes < fillBytes)
+	if (requiredClusterCount > extents.getClusterCount())
 	{
-		// TODO: tady by sla optimalizace zapisem po vice clusterech najednou
-		status = WriteClusterRange(diskNumber, bootRecord, currentCluster, 1, clusterBuffer.data());
+		const int32_t lastFileCluster = static_cast<int32_t>(extents.getLastCluster());
+		const size_t clustersToAllocate = static_cast<size_t>(requiredClusterCount - extents.getClusterCount());
+
+		EStatus status = AllocateClusters(fatTable, lastFileCluster, clustersToAllocate, &extents);
 		if (status != EStatus::SUCCESS)
 		{
 			return status;
 		}
-
-		writtenBytes += clusterSize;
-		currentCluster = fatTable[currentCluster];
 	}
 
-	// zapis data
-	// musi se spravne zapsat od offsetu
-	bytesWritten += writtenBytes;
-	writtenBytes = 0;
-
-	// nastavi bytesToWrite na velikost, ktera v poslednim clusteru  jeste zbyva
-	// v pripade, ze by to bylo moc (bufferSize je mensi), nastavi se na mensi
-	size_t clusterOffset = offset % clusterSize;
-	bytesToWrite = clusterSize - (offset % clusterSize);
-	if (bytesToWrite > bufferSize)
+	if (offset > file.size)
 	{
-		bytesToWrite = bufferSize;
-	}
+		// offset je za koncem souboru, mezeru vyplnime nulami
+		const size_t fillSize = static_cast<size_t>(offset - file.size);
 
-	status = ReadClusterRange(diskNumber, bootRecord, currentCluster, 1, clusterBuffer.data(), clusterSize, 0);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
-
-	std::memcpy(clusterBuffer.data() + clusterOffset, buffer, bytesToWrite);
-
-	status = WriteClusterRange(diskNumber, bootRecord, currentCluster, 1, clusterBuffer.data());
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
-
-	writtenBytes += bytesToWrite;
-
-	if ((writtenBytes + clusterSize) <= bufferSize)
-	{
-		// jeste zbyva dost dat k zapsani a muzeme zapisovat po celych clusterech
-		bytesToWrite = clusterSize;
-
-		while (writtenBytes <= (bufferSize - clusterSize))
-		{
-			currentCluster = fatTable[currentCluster];
-
-			status = WriteClusterRange(diskNumber, bootRecord, currentCluster, 1, buffer + writtenBytes);
-			if (status != EStatus::SUCCESS)
-			{
-				return status;
-			}
-
-			writtenBytes += bytesToWrite;
-		}
-	}
-
-	currentCluster = fatTable[currentCluster];
-
-	// jeste musime zapsat 'ocasek' dat na posledni cluster
-	if (writtenBytes != bufferSize)
-	{
-		status = ReadClusterRange(diskNumber, bootRecord, currentCluster, 1, clusterBuffer.data(), clusterSize, 0);
+		EStatus status = WriteFileRange(diskNumber, bootRecord, extents, file.size, nullptr, fillSize);
 		if (status != EStatus::SUCCESS)
 		{
 			return status;
 		}
+	}
 
-		// prepsat zacatek clusteru zbyvajicimi daty
-		bytesToWrite = bufferSize - writtenBytes;
-		std::memcpy(clusterBuffer.data(), buffer+ writtenBytes, bytesToWrite);
-
-		// zapsat
-		status = WriteClusterRange(diskNumber, bootRecord, currentCluster, 1, clusterBuffer.data());
-		if (status != EStatus::SUCCESS)
-		{
-			return status;
-		}
+	// zapis data
+	EStatus status = WriteFileRange(diskNumber, bootRecord, extents, offset, buffer, bufferSize);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
 	}
 
 	// spravne nastaveni velikosti souboru
-	if ((offset + bufferSize) > file.size)
+	if (endOffset > file.size)
 	{
-		file.size = static_cast<uint32_t>(offset + bufferSize);
+		file.size = static_cast<uint32_t>(endOffset);
 	}
 
-	bytesWritten += writtenBytes;
+	bytesWritten = bufferSize;
 
-	// update FAT
-	return UpdateFAT(diskNumber, bootRecord, fatTable);
+	return EStatus::SUCCESS;
 }
 
-EStatus FAT::DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-                        const Directory & parentDirectory, Directory & file)
+EStatus FAT::DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+                        const Directory & parentDirectory, Directory & file, DirectoryIndex *pIndex)
 {
 	std::string origFileName = file.name;
 	int32_t cluster = file.start_cluster;
@@ -831,7 +846,7 @@ EStatus FAT::DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32
 	// update itemu v adresari
 	file.clear();
 
-	EStatus status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, origFileName.c_str(), file);
+	EStatus status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, origFileName.c_str(), file, pIndex);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
@@ -842,19 +857,38 @@ EStatus FAT::DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32
 	{
 		prevCluster = cluster;
 		cluster = fatTable[cluster];
-		fatTable[prevCluster] = FAT_UNUSED;
+		fatTable.set(prevCluster, FAT_UNUSED);
 	}
 
-	return UpdateFAT(diskNumber, bootRecord, fatTable);
+	return EStatus::SUCCESS;
 }
 
-EStatus FAT::CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-                        const Directory & parentDirectory, Directory & newFile)
+EStatus FAT::CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+                        const Directory & parentDirectory, Directory & newFile, DirectoryIndex *pIndex)
 {
-	const int32_t dirLastCluster = FindLastFileCluster(fatTable, parentDirectory.start_cluster);
+	DirectoryIndex index;
+
+	if (!pIndex)
+	{
+		EStatus status = LoadDirectory(diskNumber, bootRecord, fatTable, parentDirectory, index);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		pIndex = &index;
+	}
+
+	size_t slot = 0;
+
+	// jmeno uz v adresari je
+	if (pIndex->find(newFile.name, slot))
+	{
+		return EStatus::INVALID_ARGUMENT;
+	}
 
 	// zjistit jestli je misto ve FAT
-	int32_t nextFreeCluster = GetFreeCluster(fatTable, bootRecord.usable_cluster_count);
+	int32_t nextFreeCluster = fatTable.findFreeCluster();
 	if (nextFreeCluster == NO_CLUSTER)
 	{
 		return EStatus::NOT_ENOUGH_DISK_SPACE;
@@ -864,25 +898,23 @@ EStatus FAT::CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, int32
 	newFile.start_cluster = nextFreeCluster;
 	newFile.size = 0;
 
-	fatTable[newFile.start_cluster] = FAT_FILE_END;
+	fatTable.set(newFile.start_cluster, FAT_FILE_END);
 
 	std::vector<char> dirClusterBuffer;
 	dirClusterBuffer.resize(BytesPerCluster(bootRecord), 0);
 
-	// zavolat update s puvodnim jmenem '\0'
-	// pokud bude file not found => rodicovsky adresar je plny
-	EStatus status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, "", newFile);
-	if (status == EStatus::FILE_NOT_FOUND)
+	if (!pIndex->findFreeSlot(slot))
 	{
 		// adresar je plny => alokovat novy cluster
-		nextFreeCluster = GetFreeCluster(fatTable, bootRecord.usable_cluster_count);
-		if (nextFreeCluster == NO_CLUSTER)
+		const int32_t dirLastCluster = static_cast<int32_t>(pIndex->getExtents().getLastCluster());
+
+		EStatus status = AllocateClusters(fatTable, dirLastCluster, 1);
+		if (status != EStatus::SUCCESS)
 		{
-			return EStatus::NOT_ENOUGH_DISK_SPACE;
+			return status;
 		}
 
-		fatTable[dirLastCluster] = nextFreeCluster;
-		fatTable[nextFreeCluster] = FAT_FILE_END;
+		nextFreeCluster = fatTable[dirLastCluster];
 
 		// prepsat novy dir cluster 0
 		status = WriteClusterRange(diskNumber, bootRecord, nextFreeCluster, 1, dirClusterBuffer.data());
@@ -891,14 +923,12 @@ EStatus FAT::CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, int32
 			return status;
 		}
 
-		status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, "", newFile);
-		if (status != EStatus::SUCCESS)
-		{
-			// zase nejaka chyba, tady uz je neocekavana
-			return status;
-		}
+		pIndex->appendCluster(nextFreeCluster, dirClusterBuffer.size());
 	}
-	else if (status != EStatus::SUCCESS)
+
+	// zavolat update s puvodnim jmenem '\0', tedy do prvni volne polozky
+	EStatus status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, "", newFile, pIndex);
+	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
@@ -910,162 +940,127 @@ EStatus FAT::CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, int32
 		return status;
 	}
 
-	// zapis update FAT
-	return UpdateFAT(diskNumber, bootRecord, fatTable);
+	return EStatus::SUCCESS;
 }
 
-EStatus FAT::UpdateFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
-                        const Directory & parentDirectory, const char *originalFileName, const Directory & file)
+EStatus FAT::UpdateFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+                        const Directory & parentDirectory, const char *originalFileName, const Directory & file,
+                        DirectoryIndex *pIndex)
 {
-	const size_t clusterSize = BytesPerCluster(bootRecord);
-	const size_t dirClusters = CountFileClusters(fatTable, parentDirectory.start_cluster);
-	const size_t maxItemsInDir = (clusterSize * dirClusters) / sizeof (Directory);
-
-	std::vector<char> buffer;
-	buffer.resize(clusterSize * dirClusters, 0);
+	DirectoryIndex index;
 
-	size_t read = 0;
-
-	// nacti cely adresar
-	EStatus status = ReadFile(diskNumber, bootRecord, fatTable, parentDirectory, buffer.data(), buffer.size(), read, 0);
-	if (status != EStatus::SUCCESS)
+	if (!pIndex)
 	{
-		return status;
-	}
-
-	size_t i = 0;
-	Directory *dirItems = reinterpret_cast<Directory*>(buffer.data());
-
-	// najdi item v adresari
-	for (; i < maxItemsInDir; i++)
-	{
-		if (std::strcmp(originalFileName, dirItems[i].name) == 0)
+		EStatus status = LoadDirectory(diskNumber, bootRecord, fatTable, parentDirectory, index);
+		if (status != EStatus::SUCCESS)
 		{
-			break;
+			return status;
 		}
+
+		pIndex = &index;
 	}
 
-	// je item v adresari?
-	if (i >= maxItemsInDir)
+	size_t slot = 0;
+
+	// najdi item v adresari
+	const bool isFound = (originalFileName[0] == '\0') ? pIndex->findFreeSlot(slot) : pIndex->find(originalFileName, slot);
+	if (!isFound)
 	{
 		return EStatus::FILE_NOT_FOUND;
 	}
 
-	const size_t offset = i * sizeof (Directory);
+	const Directory originalItem = pIndex->getItem(slot);
 
 	// update itemu
-	std::memcpy(buffer.data() + offset, &file, sizeof (Directory));
+	pIndex->setItem(slot, file);
 
-	// podle offsetu pozname ktery cluster zapsat
-	// directory k update je ve stejném clusteru
-	const int32_t c1 = static_cast<int32_t>(offset / clusterSize);
-	const int32_t c2 = static_cast<int32_t>((offset + sizeof (Directory) - 1) / clusterSize);
-
-	const int32_t realC1 = LogClusterToReal(fatTable, parentDirectory.start_cluster, c1);
-	const int32_t realC2 = LogClusterToReal(fatTable, parentDirectory.start_cluster, c2);
-
-	status = WriteClusterRange(diskNumber, bootRecord, realC1, 1, buffer.data() + (c1 * clusterSize));
+	EStatus status = WriteDirectorySlot(diskNumber, bootRecord, *pIndex, slot);
 	if (status != EStatus::SUCCESS)
 	{
-		return status;
-	}
+		pIndex->setItem(slot, originalItem);
 
-	if (c1 != c2)
-	{
-		// dir je ve dvou ruznych clusterech -> musime prepsat oba
-		status = WriteClusterRange(diskNumber, bootRecord, realC2, 1, buffer.data() + (c2 * clusterSize));
-		if (status != EStatus::SUCCESS)
-		{
-			return status;
-		}
+		return status;
 	}
 
 	return EStatus::SUCCESS;
 }
 
-EStatus FAT::ResizeFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-                        const Directory & parentDirectory, Directory & file, uint64_t newSize)
+EStatus FAT::ResizeFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+                        const Directory & parentDirectory, Directory & file, uint64_t newSize,
+                        DirectoryIndex *pIndex)
 {
-	const size_t oldSize = file.size;
-	const size_t bytesPerCluster = BytesPerCluster(bootRecord);
-	const size_t currentClusterCount = static_cast<size_t>(Util::DivCeil(file.size, bytesPerCluster));
+	const uint64_t oldSize = file.size;
 
-	size_t newClusterCount = static_cast<size_t>(Util::DivCeil(newSize, bytesPerCluster));
-	if (newClusterCount == 0)
+	if (newSize == oldSize)
 	{
-		newClusterCount = 1;  // kazdy soubor ma alespon 1 cluster
+		return EStatus::SUCCESS;
 	}
 
-	bool fatDirty = false;
-	bool dirDirty = false;
-
-	file.size = static_cast<uint32_t>(newSize);
-
-	if (newSize > oldSize)
+	if (newSize > UINT32_MAX)
 	{
-		dirDirty = true;
+		// velikost souboru se do polozky v adresari nevejde
+		return EStatus::NOT_ENOUGH_DISK_SPACE;
+	}
 
-		size_t written;
+	ExtentMap extents;
+	BuildExtentMap(fatTable, file.start_cluster, extents);
 
-		// v podstate je treba zapsat newSize - oldSize 0 na konec souboru
-		// coz se da prevest jako zapis 1 0 na offsetu newSize-1
-		EStatus status = WriteFile(diskNumber, bootRecord, fatTable, file, "", 1, written, newSize-1);
-		if (status != EStatus::SUCCESS)
-		{
-			return status;
-		}
-	}
-	else if (newSize < oldSize)
+	const size_t bytesPerCluster = BytesPerCluster(bootRecord);
+
+	uint64_t newClusterCount = Util::DivCeil(newSize, bytesPerCluster);
+	if (newClusterCount == 0)
 	{
-		dirDirty = true;
+		newClusterCount = 1;  // kazdy soubor ma alespon 1 cluster
+	}
 
-		if (newClusterCount < currentClusterCount)
+	if (newSize > oldSize)
+	{
+		if (newClusterCount > extents.getClusterCount())
 		{
-			// je potreba dealokovat clustery
-			fatDirty = true;
-
-			int32_t currentCluster = file.start_cluster;
-			size_t clusterCounter = 1;
+			const int32_t lastCluster = static_cast<int32_t>(extents.getLastCluster());
+			const size_t clustersToAllocate = static_cast<size_t>(newClusterCount - extents.getClusterCount());
 
-			while (currentCluster != FAT_FILE_END)
+			EStatus status = AllocateClusters(fatTable, lastCluster, clustersToAllocate, &extents);
+			if (status != EStatus::SUCCESS)
 			{
-				int32_t tmpCluster = currentCluster;
-				currentCluster = fatTable[currentCluster];
-
-				if (clusterCounter > newClusterCount)
-				{
-					fatTable[tmpCluster] = FAT_UNUSED;
-				}
-
-				clusterCounter++;
+				return status;
 			}
 		}
-	}
 
-	// update dir polozku
-	if (dirDirty)
-	{
-		EStatus status = UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, file.name, file);
+		// nove pridana cast souboru se vyplni nulami
+		const size_t fillSize = static_cast<size_t>(newSize - oldSize);
+
+		EStatus status = WriteFileRange(diskNumber, bootRecord, extents, oldSize, nullptr, fillSize);
 		if (status != EStatus::SUCCESS)
 		{
 			return status;
 		}
 	}
-
-	// update fat
-	if (fatDirty)
+	else if (newClusterCount < extents.getClusterCount())
 	{
-		EStatus status = UpdateFAT(diskNumber, bootRecord, fatTable);
-		if (status != EStatus::SUCCESS)
+		// je potreba dealokovat clustery za novym koncem souboru
+		const int32_t newLastCluster = static_cast<int32_t>(extents.getPhysicalCluster(newClusterCount - 1));
+
+		int32_t currentCluster = fatTable[newLastCluster];
+
+		fatTable.set(newLastCluster, FAT_FILE_END);
+
+		while (currentCluster != FAT_FILE_END)
 		{
-			return status;
+			const int32_t tmpCluster = currentCluster;
+			currentCluster = fatTable[currentCluster];
+
+			fatTable.set(tmpCluster, FAT_UNUSED);
 		}
 	}
 
-	return EStatus::SUCCESS;
+	file.size = static_cast<uint32_t>(newSize);
+
+	// update dir polozku
+	return UpdateFile(diskNumber, bootRecord, fatTable, parentDirectory, file.name, file, pIndex);
 }
 
-EStatus FAT::FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
+EStatus FAT::FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
                       const std::vector<std::string> & filePath, Directory & foundFile,
                       Directory & parentDirectory, uint32_t & matchCounter)
 {
@@ -1080,26 +1075,20 @@ EStatus FAT::FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const i
 		return EStatus::SUCCESS;
 	}
 
-	std::vector<Directory> dirItems;
-
-	// nacti obsah rootu
+	// zacni v rootu
 	parentDirectory.start_cluster = ROOT_CLUSTER;
 	parentDirectory.flags = FileAttributes::DIRECTORY;
 	parentDirectory.name[0] = '\0';
 
-	EStatus status = ReadDirectory(diskNumber, bootRecord, fatTable, parentDirectory, dirItems);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
-
 	for (size_t i = 0; i < filePath.size(); i++)
 	{
-		Directory *pItem = GetDirectoryItem(filePath[i], dirItems);
-		if (!pItem)
+		Directory item;
+
+		EStatus status = FindItem(diskNumber, bootRecord, fatTable, parentDirectory, filePath[i], item);
+		if (status != EStatus::SUCCESS)
 		{
 			// item nenalezen
-			return EStatus::FILE_NOT_FOUND;
+			return status;
 		}
 
 		// item nalezen
@@ -1107,12 +1096,12 @@ EStatus FAT::FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const i
 		// pokud ne, zanoreni do dalsi urovne
 		if (i == filePath.size()-1)
 		{
-			foundFile = *pItem;
+			foundFile = item;
 			matchCounter++;
 			break;
 		}
 
-		if (!pItem->isDirectory())
+		if (!item.isDirectory())
 		{
 			// jeste nejsme na konci cesty, ale byl nalezen file misto adresare
 			return EStatus::INVALID_ARGUMENT;
@@ -1120,17 +1109,38 @@ EStatus FAT::FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const i
 
 		// nejsme na konci cesty
 		// zanoreni do prave nalezeneho adresare
-		parentDirectory = *pItem;
+		parentDirectory = item;
 		matchCounter++;
+	}
 
-		dirItems.clear();
+	return EStatus::SUCCESS;
+}
 
-		status = ReadDirectory(diskNumber, bootRecord, fatTable, parentDirectory, dirItems);
+EStatus FAT::FindItem(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+                      const Directory & directory, const std::string & name, Directory & item,
+                      const DirectoryIndex *pIndex)
+{
+	DirectoryIndex index;
+
+	if (!pIndex)
+	{
+		EStatus status = LoadDirectory(diskNumber, bootRecord, fatTable, directory, index);
 		if (status != EStatus::SUCCESS)
 		{
 			return status;
 		}
+
+		pIndex = &index;
 	}
 
+	size_t slot = 0;
+
+	if (!pIndex->find(name.c_str(), slot))
+	{
+		return EStatus::FILE_NOT_FOUND;
+	}
+
+	item = pIndex->getItem(slot);
+
 	return EStatus::SUCCESS;
 }
@@ -7,6 +7,8 @@
 #include "../api/hal.h"
 
 #include "file.h"  // FileAttributes
+#include "fat_table.h"
+#include "extent_map.h"
 #include "types.h"
 #include "status.h"
 
@@ -21,9 +23,6 @@
 // Cluster where the root directory is.
 #define ROOT_CLUSTER            0
 
-// No cluster.
-#define NO_CLUSTER              -1
-
 // Default FAT metadata.
 #define DEF_FAT_COPIES          1
 #define DEF_MIN_DATA_CL         252
@@ -32,15 +31,10 @@
 
 #define MAX_NAME_LEN            12
 
-enum
-{
-	FAT_UNUSED       = INT32_MAX - 1,
-	FAT_FILE_END     = INT32_MAX - 2,
-	FAT_BAD_CLUSTERS = INT32_MAX - 3
-};
-
 namespace FAT
 {
+	class DirectoryIndex;
+
 	// Definition of boot record.
 	struct BootRecord
 	{
@@ -128,79 +122,128 @@ namespace FAT
 	 *  EStatus::IO_ERROR chyba pri cteni z disku.
 	 */
 	EStatus Load(uint8_t diskNumber, const kiv_hal::TDrive_Parameters & diskParams,
-	             BootRecord & bootRecord, std::vector<int32_t> & fatTable);
+	             BootRecord & bootRecord, Table & fatTable);
+
+	/**
+	 * @brief Zapise na disk zmenene sektory FAT (vsech kopii).
+	 * Funkce, ktere FAT upravuji, zmeny provadi pouze v pameti. O tom, kdy se zmeny zapisou na disk, rozhoduje volajici.
+	 * Souvisle useky zmenenych sektoru se zapisuji najednou.
+	 *
+	 * @return
+	 *  EStatus::SUCCESS zmeny zapsany, tabulka neobsahuje zadne nezapsane zmeny.
+	 *  EStatus::IO_ERROR chyba pri zapisu na disk, nezapsane zmeny zustanou v tabulce.
+	 */
+	EStatus Flush(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable);
+
+	/**
+	 * @brief Sestavi mapu souvislych useku clusteru souboru zacinajiciho na startCluster.
+	 * Prochazi cely retezec clusteru ve FAT, takze je vhodne mapu uchovat a znovu pouzit, dokud se retezec nezmeni.
+	 */
+	void BuildExtentMap(const Table & fatTable, int32_t startCluster, ExtentMap & extents);
+
+	/**
+	 * @brief Nacte cely obsah adresare z disku a sestavi z nej index polozek.
+	 *
+	 * @param pExtents Mapa clusteru adresare. Pokud je zadana, FAT se vubec necte.
+	 *
+	 * @return
+	 *  EStatus::SUCCESS adresar nacten.
+	 *  EStatus::INVALID_ARGUMENT pokud dir neni slozka.
+	 */
+	EStatus LoadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+	                      const Directory & directory, DirectoryIndex & index, const ExtentMap *pExtents = nullptr);
 
 	/**
 	 * @brief Nacte polozky v adresari do result.
 	 *
+	 * @param pIndex Index adresare. Pokud neni zadan, adresar se nacte z disku.
+	 *
 	 * @return
 	 *  EStatus::SUCCESS polozky nacteny.
 	 *  EStatus::INVALID_ARGUMENT pokud dir neni slozka.
 	 */
-	EStatus ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
-	                      const Directory & directory, std::vector<Directory> & result);
+	EStatus ReadDirectory(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+	                      const Directory & directory, std::vector<Directory> & result,
+	                      const DirectoryIndex *pIndex = nullptr);
 
 	/**
 	 * @brief Precte obsah souboru do bufferu.
 	 *
 	 * @param bufferLen Velikost buffero do ktereho se cte. V podstate udava, kolik max bytu precist ze souboru.
 	 * @param offset Offset od ktereho cist. Pokud je vetsi nebo roven soucasne velikosti souboru, nic nebude precteno.
+	 * @param pExtents Aktualni mapa useku souboru. Pokud neni zadana, sestavi se z FAT.
 	 *
 	 * @return
 	 *  EStatus::SUCCESS obsah souboru precten.
 	 *  EStatus::INVALID_ARGUMENT fileToRead neni soubor (ale adresar).
 	 */
-	EStatus ReadFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable, const Directory & file,
-	                 char *buffer, size_t bufferSize, size_t & bytesRead, uint64_t offset = 0);
+	EStatus ReadFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable, const Directory & file,
+	                 char *buffer, size_t bufferSize, size_t & bytesRead, uint64_t offset = 0,
+	                 const ExtentMap *pExtents = nullptr);
 
 	/**
 	 * @brief Zapise do existujiciho souboru data z bufferu.
 	 *
 	 * @param offset Offset v bytech od ktereho se ma zapisovat. Pokud presahuje soucasnou velikost souboru, soubor bude
 	 * rozsiren o nuly.
+	 * @param pExtents Aktualni mapa useku souboru. Pokud neni zadana, sestavi se z FAT. Nove alokovane clustery se do ni
+	 * pridaji.
 	 *
 	 * @return
 	 *  EStatus::SUCCESS uspesne zapsano do souboru.
 	 */
-	EStatus WriteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable, Directory & file,
-	                  const char *buffer, size_t bufferSize, size_t & bytesWritten, uint64_t offset = 0);
+	EStatus WriteFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable, Directory & file,
+	                  const char *buffer, size_t bufferSize, size_t & bytesWritten, uint64_t offset = 0,
+	                  ExtentMap *pExtents = nullptr);
 
 	/**
 	 * @brief Smaze zadany soubor.
 	 * Data realne zustanou na disku, pouze se upravi FAT a directory zaznam v rodicovskem adresari. Parametr file bude po
 	 * zavolani teto funkce obsahovat pouze nuly.
+	 *
+	 * @param pIndex Index rodicovskeho adresare. Pokud neni zadan, adresar se nacte z disku.
 	 */
-	EStatus DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-	                   const Directory & parentDirectory, Directory & file);
+	EStatus DeleteFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+	                   const Directory & parentDirectory, Directory & file, DirectoryIndex *pIndex = nullptr);
 
 	/**
 	 * @brief Vytvori novy soubor v danem rodicovskem adresari
 	 *
+	 * @param pIndex Index rodicovskeho adresare. Pokud neni zadan, adresar se nacte z disku. Pokud je adresar plny,
+	 * prida se do nej novy cluster.
+	 *
 	 * @return
 	 *  EStatus::SUCCESS soubor vytvoren, newFile ma nastaveny start_cluster a size.
+	 *  EStatus::INVALID_ARGUMENT pokud uz adresar obsahuje polozku se stejnym jmenem.
 	 */
-	EStatus CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-	                   const Directory & parentDirectory, Directory & newFile);
+	EStatus CreateFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+	                   const Directory & parentDirectory, Directory & newFile, DirectoryIndex *pIndex = nullptr);
 
 	/**
 	 * @brief Prehraje zadanou polozku (file) v zadanem adresari (parentDirectory).
 	 *
-	 * @param originalFileName Puvodni jmeno souboru, ktery ma byt nahrazen.
+	 * @param originalFileName Puvodni jmeno souboru, ktery ma byt nahrazen. Prazdne jmeno znamena prvni volnou polozku.
+	 * @param pIndex Index rodicovskeho adresare. Pokud neni zadan, adresar se nacte z disku. Na disk se zapise pouze
+	 * cluster se zmenenou polozkou.
 	 *
 	 * @return
 	 *  EStatus::SUCCESS pokud vse v poradku
 	 *  EStatus::FILE_NOT_FOUND pokud nebyl file nalezen v rodicovskem adresari.
 	 */
-	EStatus UpdateFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
-	                   const Directory & parentDirectory, const char *originalFileName, const Directory & file);
+	EStatus UpdateFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+	                   const Directory & parentDirectory, const char *originalFileName, const Directory & file,
+	                   DirectoryIndex *pIndex = nullptr);
 
 	/**
 	 * @brief Zmeni velikost souboru.
 	 * Z disku se realne nic nemaze, pouze se upravuje FAT a polozka Directory.size.
 	 * Pri zvetseni souboru se prazdne misto vyplni 0.
+	 *
+	 * @param pIndex Index rodicovskeho adresare. Pokud neni zadan, adresar se nacte z disku.
 	 */
-	EStatus ResizeFile(uint8_t diskNumber, const BootRecord & bootRecord, int32_t *fatTable,
-	                   const Directory & parentDirectory, Directory & file, uint64_t newSize);
+	EStatus ResizeFile(uint8_t diskNumber, const BootRecord & bootRecord, Table & fatTable,
+	                   const Directory & parentDirectory, Directory & file, uint64_t newSize,
+	                   DirectoryIndex *pIndex = nullptr);
 
 	/**
 	 * @brief Pokusi se najit soubor podle zadane filePath.
@@ -221,7 +264,21 @@ namespace FAT
 	 *  EStatus::FILE_NOT_FOUND pokud soubor nebyl nalezen.
 	 *  EStatus::INVALID_ARGUMENT pokud nejaky z prvku cesty (krome posledniho) neni adresar.
 	 */
-	EStatus FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const int32_t *fatTable,
+	EStatus FindFile(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
 	                 const std::vector<std::string> & filePath, Directory & foundFile,
 	                 Directory & parentDirectory, uint32_t & matchCounter);
+
+	/**
+	 * @brief Najde polozku se zadanym jmenem v adresari.
+	 *
+	 * @param pIndex Index adresare. Pokud neni zadan, adresar se nacte z disku.
+	 *
+	 * @return
+	 *  EStatus::SUCCESS pokud byla polozka nalezena a ulozena do item.
+	 *  EStatus::FILE_NOT_FOUND pokud adresar polozku neobsahuje.
+	 *  EStatus::INVALID_ARGUMENT pokud directory neni adresar.
+	 */
+	EStatus FindItem(uint8_t diskNumber, const BootRecord & bootRecord, const Table & fatTable,
+	                 const Directory & directory, const std::string & name, Directory & item,
+	                 const DirectoryIndex *pIndex = nullptr);
 }
@@ -0,0 +1,173 @@
+#include <cstring>
+
+#include "fat_directory_index.h"
+
+namespace
+{
+	/**
+	 * @brief Vrati klic indexu pro jmeno polozky adresare. Bajty za koncem jmena se neporovnavaji.
+	 */
+	FAT::DirectoryIndex::Name ItemName(const FAT::Directory & item)
+	{
+		FAT::DirectoryIndex::Name name;
+		name.fill('\0');
+
+		for (size_t i = 0; i < name.size() - 1 && item.name[i] != '\0'; i++)
+		{
+			name[i] = item.name[i];
+		}
+
+		return name;
+	}
+}
+
+size_t FAT::DirectoryIndex::NameHash::operator()(const Name & name) const
+{
+	// FNV-1a pres vsech 12 bajtu
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (char c : name)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	return static_cast<size_t>(hash);
+}
+
+bool FAT::DirectoryIndex::MakeName(const char *name, Name & result)
+{
+	result.fill('\0');
+
+	for (size_t i = 0; name[i] != '\0'; i++)
+	{
+		if (i >= result.size() - 1)
+		{
+			// jmeno vcetne '\0' se do polozky nevejde
+			return false;
+		}
+
+		result[i] = name[i];
+	}
+
+	return true;
+}
+
+void FAT::DirectoryIndex::indexSlot(size_t slot)
+{
+	const Directory & item = getItem(slot);
+
+	if (!item.hasName())
+	{
+		m_freeSlots.insert(slot);
+		return;
+	}
+
+	// pri duplicitnim jmenu plati prvni polozka stejne jako pri prochazeni adresare
+	m_names.emplace(ItemName(item), slot);
+}
+
+void FAT::DirectoryIndex::unindexSlot(size_t slot)
+{
+	const Directory & item = getItem(slot);
+
+	if (!item.hasName())
+	{
+		m_freeSlots.erase(slot);
+		return;
+	}
+
+	auto it = m_names.find(ItemName(item));
+	if (it != m_names.end() && it->second == slot)
+	{
+		m_names.erase(it);
+	}
+}
+
+void FAT::DirectoryIndex::assign(std::vector<char> && data, ExtentMap && extents)
+{
+	m_data = std::move(data);
+	m_extents = std::move(extents);
+	m_names.clear();
+	m_freeSlots.clear();
+
+	const size_t slotCount = getSlotCount();
+
+	m_names.reserve(slotCount);
+
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		indexSlot(i);
+	}
+}
+
+void FAT::DirectoryIndex::appendCluster(int32_t cluster, size_t bytesPerCluster)
+{
+	const size_t oldSlotCount = getSlotCount();
+
+	m_data.resize(m_data.size() + bytesPerCluster, 0);
+	m_extents.append(cluster, 1);
+
+	// nove pozice, vcetne pozice zasahujici z predchoziho clusteru
+	for (size_t i = oldSlotCount; i < getSlotCount(); i++)
+	{
+		indexSlot(i);
+	}
+}
+
+void FAT::DirectoryIndex::setItem(size_t slot, const Directory & item)
+{
+	unindexSlot(slot);
+
+	std::memcpy(m_data.data() + slot * sizeof (Directory), &item, sizeof (Directory));
+
+	indexSlot(slot);
+}
+
+bool FAT::DirectoryIndex::find(const char *name, size_t & slot) const
+{
+	Name key;
+	if (!MakeName(name, key))
+	{
+		return false;
+	}
+
+	auto it = m_names.find(key);
+	if (it == m_names.end())
+	{
+		return false;
+	}
+
+	slot = it->second;
+
+	return true;
+}
+
+bool FAT::DirectoryIndex::findFreeSlot(size_t & slot) const
+{
+	if (m_freeSlots.empty())
+	{
+		return false;
+	}
+
+	slot = *m_freeSlots.begin();
+
+	return true;
+}
+
+void FAT::DirectoryIndex::getItems(std::vector<Directory> & result) const
+{
+	const size_t slotCount = getSlotCount();
+
+	result.reserve(result.size() + slotCount - m_freeSlots.size());
+
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		const Directory & item = getItem(i);
+
+		if (item.hasName())
+		{
+			result.emplace_back(item);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fat.h"
+
+namespace FAT
+{
+	/**
+	 * @brief Obsah jednoho adresare drzeny v pameti.
+	 * Polozky jsou indexovane hashovaci tabulkou podle jmena (pevnych 12 bajtu jako v polozce na disku) a volne pozice
+	 * jsou vedene zvlast, takze hledani souboru ani hledani mista pro novou polozku neprochazi cely adresar. Obsah
+	 * adresare je ulozeny po celych clusterech, aby bylo mozne zmenenou polozku zapsat na disk bez cteni.
+	 */
+	class DirectoryIndex
+	{
+	public:
+		using Name = std::array<char, MAX_NAME_LEN>;
+
+	private:
+		struct NameHash
+		{
+			size_t operator()(const Name & name) const;
+		};
+
+		std::vector<char> m_data;                             // cely obsah adresare
+		ExtentMap m_extents;                                  // clustery adresare
+		std::unordered_map<Name, size_t, NameHash> m_names;   // jmeno a pozice polozky
+		std::set<size_t> m_freeSlots;                         // pozice bez polozky serazene vzestupne
+
+		void indexSlot(size_t slot);
+		void unindexSlot(size_t slot);
+
+	public:
+		DirectoryIndex()
+		: m_data(),
+		  m_extents(),
+		  m_names(),
+		  m_freeSlots()
+		{
+		}
+
+		/**
+		 * @brief Prevede jmeno souboru na klic indexu.
+		 * @return False, pokud je jmeno prilis dlouhe a v adresari tedy nemuze byt.
+		 */
+		static bool MakeName(const char *name, Name & result);
+
+		/**
+		 * @brief Nastavi obsah adresare nacteny z disku a sestavi index.
+		 */
+		void assign(std::vector<char> && data, ExtentMap && extents);
+
+		/**
+		 * @brief Prida na konec adresare novy cluster, ktery uz je na disku vynulovany.
+		 */
+		void appendCluster(int32_t cluster, size_t bytesPerCluster);
+
+		size_t getSlotCount() const
+		{
+			return m_data.size() / sizeof (Directory);
+		}
+
+		const Directory & getItem(size_t slot) const
+		{
+			return *reinterpret_cast<const Directory*>(m_data.data() + slot * sizeof (Directory));
+		}
+
+		/**
+		 * @brief Zmeni polozku na dane pozici v pameti. Na disk nic nezapisuje.
+		 */
+		void setItem(size_t slot, const Directory & item);
+
+		/**
+		 * @brief Najde pozici polozky se zadanym jmenem.
+		 * @return False, pokud adresar polozku neobsahuje.
+		 */
+		bool find(const char *name, size_t & slot) const;
+
+		/**
+		 * @brief Vrati prvni volnou pozici v adresari.
+		 * @return False, pokud je adresar plny.
+		 */
+		bool findFreeSlot(size_t & slot) const;
+
+		/**
+		 * @brief Vrati vsechny neprazdne polozky v poradi, v jakem jsou v adresari.
+		 */
+		void getItems(std::vector<Directory> & result) const;
+
+		bool isEmpty() const
+		{
+			return m_names.empty();
+		}
+
+		const char *data() const
+		{
+			return m_data.data();
+		}
+
+		const ExtentMap & getExtents() const
+		{
+			return m_extents;
+		}
+	};
+}
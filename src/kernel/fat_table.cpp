@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "fat_table.h"
+#include "compiler.h"
+
+#define BITS_PER_WORD  64
+
+void FAT::Table::markDirty(int32_t cluster)
+{
+	const uint64_t fatSizeBytes = m_entries.size() * sizeof (int32_t);
+	const uint64_t entryOffset = static_cast<uint64_t>(cluster) * sizeof (int32_t);
+
+	// polozka je ve vsech kopiich FAT
+	for (uint8_t i = 0; i < m_fatCopies; i++)
+	{
+		const uint64_t diskOffset = m_fatOffset + i * fatSizeBytes + entryOffset;
+
+		// polozky jsou zarovnane na 4 B, takze nikdy nepresahuji hranici sektoru
+		m_dirtySectors.insert(diskOffset / m_bytesPerSector);
+	}
+}
+
+bool FAT::Table::isFree(int32_t cluster) const
+{
+	if (cluster < 0 || static_cast<size_t>(cluster) >= m_entries.size())
+	{
+		return false;
+	}
+
+	return (m_freeMap[cluster / BITS_PER_WORD] >> (cluster % BITS_PER_WORD)) & 1;
+}
+
+void FAT::Table::addFreeExtent(int32_t start, int32_t length)
+{
+	m_freeExtents.emplace(start, length);
+	m_freeExtentsBySize.emplace(length, start);
+}
+
+void FAT::Table::removeFreeExtent(std::map<int32_t, int32_t>::iterator it)
+{
+	m_freeExtentsBySize.erase(std::make_pair(it->second, it->first));
+	m_freeExtents.erase(it);
+}
+
+void FAT::Table::setFree(int32_t cluster)
+{
+	const size_t word = static_cast<size_t>(cluster) / BITS_PER_WORD;
+
+	// spojeni se sousednimi volnymi useky
+	int32_t start = cluster;
+	int32_t length = 1;
+
+	if (isFree(cluster - 1))
+	{
+		auto it = std::prev(m_freeExtents.upper_bound(cluster - 1));
+
+		start = it->first;
+		length += it->second;
+
+		removeFreeExtent(it);
+	}
+
+	if (isFree(cluster + 1))
+	{
+		auto it = m_freeExtents.find(cluster + 1);
+
+		length += it->second;
+
+		removeFreeExtent(it);
+	}
+
+	addFreeExtent(start, length);
+
+	m_freeMap[word] |= 1ULL << (cluster % BITS_PER_WORD);
+	m_freeMapSummary[word / BITS_PER_WORD] |= 1ULL << (word % BITS_PER_WORD);
+	m_freeCount++;
+}
+
+void FAT::Table::setUsed(int32_t cluster)
+{
+	const size_t word = static_cast<size_t>(cluster) / BITS_PER_WORD;
+
+	// rozdeleni useku, ve kterem cluster lezi
+	auto it = std::prev(m_freeExtents.upper_bound(cluster));
+
+	const int32_t start = it->first;
+	const int32_t end = it->first + it->second;
+
+	removeFreeExtent(it);
+
+	if (start < cluster)
+	{
+		addFreeExtent(start, cluster - start);
+	}
+
+	if (cluster + 1 < end)
+	{
+		addFreeExtent(cluster + 1, end - (cluster + 1));
+	}
+
+	m_freeMap[word] &= ~(1ULL << (cluster % BITS_PER_WORD));
+	m_freeCount--;
+
+	if (m_freeMap[word] == 0)
+	{
+		// ve slove uz neni zadny volny cluster
+		m_freeMapSummary[word / BITS_PER_WORD] &= ~(1ULL << (word % BITS_PER_WORD));
+	}
+}
+
+void FAT::Table::buildFreeMap()
+{
+	const size_t wordCount = (m_entries.size() + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+	m_freeMap.assign(wordCount, 0);
+	m_freeMapSummary.assign((wordCount + BITS_PER_WORD - 1) / BITS_PER_WORD, 0);
+	m_freeCount = 0;
+	m_nextFreeHint = 0;
+	m_freeExtents.clear();
+	m_freeExtentsBySize.clear();
+
+	const int32_t size = static_cast<int32_t>(m_entries.size());
+
+	int32_t extentStart = NO_CLUSTER;
+
+	for (int32_t i = 0; i <= size; i++)
+	{
+		if (i < size && m_entries[i] == FAT_UNUSED)
+		{
+			const size_t word = static_cast<size_t>(i) / BITS_PER_WORD;
+
+			m_freeMap[word] |= 1ULL << (i % BITS_PER_WORD);
+			m_freeMapSummary[word / BITS_PER_WORD] |= 1ULL << (word % BITS_PER_WORD);
+			m_freeCount++;
+
+			if (extentStart == NO_CLUSTER)
+			{
+				extentStart = i;
+			}
+		}
+		else if (extentStart != NO_CLUSTER)
+		{
+			// konec souvisleho useku volnych clusteru
+			addFreeExtent(extentStart, i - extentStart);
+
+			extentStart = NO_CLUSTER;
+		}
+	}
+}
+
+/**
+ * @brief Vrati prvni volny cluster z rozsahu <begin, end) nebo NO_CLUSTER.
+ * Slova bitmapy bez volnych clusteru se preskakuji pomoci souhrnne bitmapy, takze se neprochazi cela FAT.
+ */
+int32_t FAT::Table::findFreeInRange(size_t begin, size_t end) const
+{
+	if (begin >= end)
+	{
+		return NO_CLUSTER;
+	}
+
+	const size_t lastWord = (end - 1) / BITS_PER_WORD;
+
+	size_t word = begin / BITS_PER_WORD;
+	uint64_t bits = m_freeMap[word] & (~0ULL << (begin % BITS_PER_WORD));
+
+	while (bits == 0)
+	{
+		// najdi dalsi slovo, ktere obsahuje volny cluster
+		word++;
+
+		if (word > lastWord)
+		{
+			return NO_CLUSTER;
+		}
+
+		size_t summaryWord = word / BITS_PER_WORD;
+		uint64_t summaryBits = m_freeMapSummary[summaryWord] & (~0ULL << (word % BITS_PER_WORD));
+
+		while (summaryBits == 0)
+		{
+			summaryWord++;
+
+			if (summaryWord * BITS_PER_WORD > lastWord)
+			{
+				return NO_CLUSTER;
+			}
+
+			summaryBits = m_freeMapSummary[summaryWord];
+		}
+
+		word = summaryWord * BITS_PER_WORD + COMPILER_COUNT_TRAILING_ZEROS_64(summaryBits);
+
+		if (word > lastWord)
+		{
+			return NO_CLUSTER;
+		}
+
+		bits = m_freeMap[word];
+	}
+
+	const size_t cluster = word * BITS_PER_WORD + COMPILER_COUNT_TRAILING_ZEROS_64(bits);
+
+	return (cluster < end) ? static_cast<int32_t>(cluster) : NO_CLUSTER;
+}
+
+void FAT::Table::assign(std::vector<int32_t> && entries, uint64_t fatOffset, uint16_t bytesPerSector, uint8_t fatCopies)
+{
+	m_entries = std::move(entries);
+	m_dirtySectors.clear();
+	m_journal.clear();
+	m_fatOffset = fatOffset;
+	m_bytesPerSector = bytesPerSector;
+	m_fatCopies = fatCopies;
+
+	buildFreeMap();
+}
+
+void FAT::Table::set(int32_t cluster, int32_t value)
+{
+	int32_t & entry = m_entries[cluster];
+
+	if (entry == value)
+	{
+		return;
+	}
+
+	m_journal.emplace_back(cluster, entry);
+
+	if (entry == FAT_UNUSED)
+	{
+		setUsed(cluster);
+
+		// dalsi volny cluster budeme hledat az za timto
+		m_nextFreeHint = (static_cast<size_t>(cluster) + 1 < m_entries.size()) ? cluster + 1 : 0;
+	}
+	else if (value == FAT_UNUSED)
+	{
+		setFree(cluster);
+	}
+
+	entry = value;
+
+	markDirty(cluster);
+}
+
+int32_t FAT::Table::findFreeCluster() const
+{
+	if (m_freeCount == 0)
+	{
+		return NO_CLUSTER;
+	}
+
+	const size_t hint = static_cast<size_t>(m_nextFreeHint);
+
+	int32_t cluster = findFreeInRange(hint, m_entries.size());
+	if (cluster == NO_CLUSTER)
+	{
+		// pokracuj od zacatku
+		cluster = findFreeInRange(0, hint);
+	}
+
+	return cluster;
+}
+
+size_t FAT::Table::findFreeExtent(size_t count, int32_t preferredCluster, int32_t & start) const
+{
+	if (m_freeExtents.empty())
+	{
+		return 0;
+	}
+
+	// usek hned za souborem, aby soubor zustal souvisly
+	if (isFree(preferredCluster) && !isFree(preferredCluster - 1))
+	{
+		auto it = m_freeExtents.find(preferredCluster);
+
+		start = it->first;
+
+		return static_cast<size_t>(it->second);
+	}
+
+	// nejmensi usek, do ktereho se vejde cely pozadavek
+	const int32_t requested = (count > static_cast<size_t>(INT32_MAX)) ? INT32_MAX : static_cast<int32_t>(count);
+
+	auto it = m_freeExtentsBySize.lower_bound(std::make_pair(requested, INT32_MIN));
+	if (it == m_freeExtentsBySize.end())
+	{
+		// zadny usek neni dost velky, takze vezmeme nejvetsi
+		it = std::prev(m_freeExtentsBySize.end());
+	}
+
+	start = it->second;
+
+	return static_cast<size_t>(it->first);
+}
+
+void FAT::Table::copyToDiskRange(uint64_t diskOffset, size_t length, char *buffer) const
+{
+	const uint64_t fatSizeBytes = m_entries.size() * sizeof (int32_t);
+	const uint64_t rangeEnd = diskOffset + length;
+
+	for (uint8_t i = 0; i < m_fatCopies; i++)
+	{
+		const uint64_t copyBegin = m_fatOffset + i * fatSizeBytes;
+		const uint64_t copyEnd = copyBegin + fatSizeBytes;
+
+		const uint64_t begin = std::max(copyBegin, diskOffset);
+		const uint64_t end = std::min(copyEnd, rangeEnd);
+
+		if (begin >= end)
+		{
+			continue;
+		}
+
+		const char *source = reinterpret_cast<const char*>(m_entries.data()) + (begin - copyBegin);
+
+		std::memcpy(buffer + (begin - diskOffset), source, static_cast<size_t>(end - begin));
+	}
+}
+
+void FAT::Table::rollbackTransaction()
+{
+	std::vector<std::pair<int32_t, int32_t>> journal;
+	journal.swap(m_journal);
+
+	// obnoveni v opacnem poradi, aby u vicekrat zmenenych polozek zustala nejstarsi hodnota
+	for (auto it = journal.rbegin(); it != journal.rend(); ++it)
+	{
+		set(it->first, it->second);
+	}
+
+	m_journal.clear();
+}
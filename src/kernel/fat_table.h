@@ -0,0 +1,146 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+// No cluster.
+#define NO_CLUSTER              -1
+
+enum
+{
+	FAT_UNUSED       = INT32_MAX - 1,
+	FAT_FILE_END     = INT32_MAX - 2,
+	FAT_BAD_CLUSTERS = INT32_MAX - 3
+};
+
+namespace FAT
+{
+	/**
+	 * @brief FAT tabulka drzena v pameti.
+	 * Vsechny zmeny polozek se provadi pres metodu set, ktera si pamatuje zmenene sektory oblasti metadat na disku (vsech
+	 * kopii FAT), aby bylo mozne na disk zapsat pouze to, co se skutecne zmenilo. Zaroven si pamatuje puvodni hodnoty
+	 * zmenenych polozek od zacatku posledni transakce, aby bylo mozne neuspesnou operaci vratit.
+	 *
+	 * Tabulka take udrzuje index volnych clusteru (dvouurovnova bitmapa a pocet volnych clusteru), takze hledani volneho
+	 * clusteru ani zjisteni volneho mista nevyzaduje prochazeni cele FAT. Souvisle useky volnych clusteru jsou navic
+	 * indexovane podle zacatku i podle delky, aby bylo mozne alokovat cele souvisle useky.
+	 */
+	class Table
+	{
+		std::vector<int32_t> m_entries;
+		std::set<uint64_t> m_dirtySectors;
+		std::vector<std::pair<int32_t, int32_t>> m_journal;  // cluster a jeho puvodni hodnota
+		uint64_t m_fatOffset = 0;      // offset prvni kopie FAT na disku v bajtech
+		uint16_t m_bytesPerSector = 0;
+		uint8_t m_fatCopies = 0;
+
+		std::vector<uint64_t> m_freeMap;         // 1 bit za kazdy cluster, nastaveny bit = volny cluster
+		std::vector<uint64_t> m_freeMapSummary;  // 1 bit za kazde slovo m_freeMap, nastaveny bit = slovo neni nulove
+		size_t m_freeCount = 0;
+		int32_t m_nextFreeHint = 0;              // odkud zacit hledat volny cluster (next-fit)
+
+		std::map<int32_t, int32_t> m_freeExtents;                   // zacatek a delka useku volnych clusteru
+		std::set<std::pair<int32_t, int32_t>> m_freeExtentsBySize;  // delka a zacatek useku volnych clusteru
+
+		void markDirty(int32_t cluster);
+
+		void setFree(int32_t cluster);
+		void setUsed(int32_t cluster);
+		void buildFreeMap();
+
+		bool isFree(int32_t cluster) const;
+		void addFreeExtent(int32_t start, int32_t length);
+		void removeFreeExtent(std::map<int32_t, int32_t>::iterator it);
+
+		int32_t findFreeInRange(size_t begin, size_t end) const;
+
+	public:
+		Table() = default;
+
+		/**
+		 * @brief Nastavi obsah tabulky nactene z disku. Tabulka neobsahuje zadne zmeny.
+		 * @param fatOffset Offset prvni kopie FAT na disku v bajtech.
+		 */
+		void assign(std::vector<int32_t> && entries, uint64_t fatOffset, uint16_t bytesPerSector, uint8_t fatCopies);
+
+		size_t getSize() const
+		{
+			return m_entries.size();
+		}
+
+		const int32_t *data() const
+		{
+			return m_entries.data();
+		}
+
+		int32_t operator[](int32_t cluster) const
+		{
+			return m_entries[cluster];
+		}
+
+		void set(int32_t cluster, int32_t value);
+
+		/**
+		 * @brief Vrati pocet volnych clusteru.
+		 */
+		size_t getFreeCount() const
+		{
+			return m_freeCount;
+		}
+
+		/**
+		 * @brief Vrati volny cluster nebo NO_CLUSTER, pokud zadny neni.
+		 * Hledani pokracuje za naposledy obsazenym clusterem (next-fit), takze postupne alokovane clustery na sebe
+		 * navazuji a nemusi se znovu prochazet zacatek disku.
+		 */
+		int32_t findFreeCluster() const;
+
+		/**
+		 * @brief Najde souvisly usek volnych clusteru pro alokaci count clusteru.
+		 * Prednostne vrati usek zacinajici na preferredCluster (typicky hned za poslednim clusterem souboru), jinak nejmensi
+		 * usek, do ktereho se vejde cely pozadavek (best-fit). Pokud takovy usek neexistuje, vrati nejvetsi volny usek.
+		 *
+		 * @param start Zacatek nalezeneho useku.
+		 * @return Delka nalezeneho useku, ktera muze byt vetsi i mensi nez count. 0 pokud neni zadny volny cluster.
+		 */
+		size_t findFreeExtent(size_t count, int32_t preferredCluster, int32_t & start) const;
+
+		bool isDirty() const
+		{
+			return !m_dirtySectors.empty();
+		}
+
+		/**
+		 * @brief Vrati cisla zmenenych sektoru oblasti metadat serazena vzestupne.
+		 */
+		const std::set<uint64_t> & getDirtySectors() const
+		{
+			return m_dirtySectors;
+		}
+
+		void clearDirty()
+		{
+			m_dirtySectors.clear();
+		}
+
+		/**
+		 * @brief Zkopiruje cast FAT (vsech kopii) lezici v zadanem rozsahu bajtu na disku do bufferu.
+		 * Mista v bufferu, ktera nepatri zadne kopii FAT, zustanou nezmenena.
+		 */
+		void copyToDiskRange(uint64_t diskOffset, size_t length, char *buffer) const;
+
+		void beginTransaction()
+		{
+			m_journal.clear();
+		}
+
+		/**
+		 * @brief Vrati vsechny polozky zmenene od zacatku posledni transakce na puvodni hodnoty.
+		 */
+		void rollbackTransaction();
+	};
+}
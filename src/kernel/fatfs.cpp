@@ -1,44 +1,375 @@
 #include "fatfs.h"
-#include "fat.h"
+#include "kernel.h"
 #include "util.h"
 
-EStatus FatFS::init(const kiv_hal::TDrive_Parameters & diskParams)
+EStatus FatFS::loadFAT()
 {
-	m_diskParams = diskParams;
+	return FAT::Load(m_diskNumber, m_diskParams, m_bootRecord, m_fatTable);
+}
 
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
+EStatus FatFS::flushFAT()
+{
+	if (m_fatTable.isDirty())
+	{
+		const size_t sectorCount = m_fatTable.getDirtySectors().size();
 
-	// disk uz mozna obsahuje souborovy system FAT
-	EStatus status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
+		EStatus status = FAT::Flush(m_diskNumber, m_bootRecord, m_fatTable);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		m_stats.fatFlushes++;
+		m_stats.flushedFATSectors += sectorCount;
+	}
+
+	// zmeny FAT i dat mohou byt zatim jen v cache sektoru
+	// cache posle disku Flush jen tehdy, pokud se na nej od posledniho Flush neco zapsalo
+	return Kernel::GetBlockCache().flush(m_diskNumber);
+}
+
+void FatFS::onFATUsed()
+{
+	// FAT je drzena v pameti od inicializace, takze ji neni potreba znovu nacitat z disku
+	m_stats.avoidedFATLoads++;
+}
+
+/**
+ * @brief Dokonci operaci, ktera mohla zmenit FAT.
+ * Pokud operace selhala, jeji zmeny FAT se vrati. V rezimu SYNC se zmeny hned zapisou na disk.
+ */
+EStatus FatFS::finishFATChanges(EStatus status)
+{
 	if (status != EStatus::SUCCESS)
 	{
-		return FAT::Init(m_diskNumber, m_diskParams);
+		// na disku muze byt jen cast zmen, ale polozka v adresari stale odkazuje na puvodni clustery
+		m_fatTable.rollbackTransaction();
 	}
 
+	if (m_flushMode == EFlushMode::SYNC)
+	{
+		EStatus flushStatus = flushFAT();
+		if (status == EStatus::SUCCESS)
+		{
+			status = flushStatus;
+		}
+	}
+
+	return status;
+}
+
+uint64_t FatFS::getChainVersion(int32_t startCluster) const
+{
+	auto it = m_chainVersions.find(startCluster);
+
+	return (it != m_chainVersions.end()) ? it->second : 0;
+}
+
+void FatFS::onChainChanged(int32_t startCluster)
+{
+	// mapy useku tohoto souboru drzene v handlech uz neplati
+	m_chainVersions[startCluster] = ++m_lastChainVersion;
+}
+
+/**
+ * @brief Zajisti, ze mapa useku odpovida aktualnimu retezci clusteru souboru.
+ */
+void FatFS::prepareExtents(const FAT::Directory & file, ExtentMap & extents)
+{
+	const uint64_t version = getChainVersion(file.start_cluster);
+
+	if (extents.isValidFor(file.start_cluster, version))
+	{
+		m_stats.extentMapHits++;
+		return;
+	}
+
+	FAT::BuildExtentMap(m_fatTable, file.start_cluster, extents);
+	extents.setValidFor(file.start_cluster, version);
+
+	m_stats.extentMapBuilds++;
+}
+
+/**
+ * @brief Vrati index adresare, pokud je v pameti, jinak null.
+ */
+FAT::DirectoryIndex *FatFS::findDirectoryIndex(int32_t startCluster)
+{
+	auto it = m_directoryIndexes.find(startCluster);
+	if (it == m_directoryIndexes.end())
+	{
+		return nullptr;
+	}
+
+	m_stats.directoryIndexHits++;
+
+	// adresar byl prave pouzit
+	m_directoryIndexLRU.splice(m_directoryIndexLRU.begin(), m_directoryIndexLRU, it->second.lruIt);
+
+	return &it->second.index;
+}
+
+/**
+ * @brief Ulozi nacteny index adresare do pameti.
+ */
+FAT::DirectoryIndex & FatFS::insertDirectoryIndex(int32_t startCluster, FAT::DirectoryIndex && index)
+{
+	m_stats.directoryLoads++;
+
+	if (m_directoryIndexes.size() >= FATFS_DIRECTORY_INDEX_CAPACITY && !m_directoryIndexLRU.empty())
+	{
+		// uvolni misto pro novy adresar zahozenim nejdele nepouziteho
+		m_directoryIndexes.erase(m_directoryIndexLRU.back());
+		m_directoryIndexLRU.pop_back();
+		m_directoryIndexDrops++;
+	}
+
+	m_directoryIndexLRU.push_front(startCluster);
+
+	DirectoryIndexNode & node = m_directoryIndexes[startCluster];
+	node.index = std::move(index);
+	node.lruIt = m_directoryIndexLRU.begin();
+
+	return node.index;
+}
+
+/**
+ * @brief Vrati index adresare. Pokud adresar jeste neni v pameti, nacte ho z disku.
+ * Vraceny ukazatel je platny do dalsiho volani teto metody.
+ */
+EStatus FatFS::getDirectoryIndex(const FAT::Directory & directory, FAT::DirectoryIndex * & pIndex)
+{
+	pIndex = findDirectoryIndex(directory.start_cluster);
+	if (pIndex)
+	{
+		return EStatus::SUCCESS;
+	}
+
+	FAT::DirectoryIndex index;
+
+	EStatus status = FAT::LoadDirectory(m_diskNumber, m_bootRecord, m_fatTable, directory, index);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	pIndex = &insertDirectoryIndex(directory.start_cluster, std::move(index));
+
 	return EStatus::SUCCESS;
 }
 
-EStatus FatFS::query(const Path & path, FileInfo *pInfo)
+/**
+ * @brief Vrati index adresare stejne jako predchozi metoda, ale adresar cte z disku s odemcenym zamkem metadat.
+ * Pouziva se pri hledani souboru, ktere drzi m_volumeLock, takze se adresare nemohou vytvaret ani mazat a menit se
+ * mohou jen velikosti souboru v jejich polozkach.
+ */
+EStatus FatFS::getDirectoryIndex(const FAT::Directory & directory, FAT::DirectoryIndex * & pIndex,
+                                 std::unique_lock<std::mutex> & metadataLock)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	pIndex = findDirectoryIndex(directory.start_cluster);
+	if (pIndex)
+	{
+		return EStatus::SUCCESS;
+	}
 
-	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
+	if (!directory.isDirectory())
+	{
+		return EStatus::INVALID_ARGUMENT;
+	}
+
+	// retezec clusteru adresare se cte z FAT jeste pod zamkem
+	ExtentMap extents;
+	FAT::BuildExtentMap(m_fatTable, directory.start_cluster, extents);
+
+	const uint64_t directoryIndexDrops = m_directoryIndexDrops;
+
+	metadataLock.unlock();
+
+	FAT::DirectoryIndex index;
+
+	EStatus status = FAT::LoadDirectory(m_diskNumber, m_bootRecord, m_fatTable, directory, index, &extents);
+
+	metadataLock.lock();
 
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
+	if (m_directoryIndexes.count(directory.start_cluster) != 0 || m_directoryIndexDrops != directoryIndexDrops)
+	{
+		// adresar mezitim nacetlo jine vlakno, ktere ho take mohlo zmenit a mezitim zase zahodit
+		// nacteny obsah tedy nemusi byt aktualni, pouzije se adresar v pameti nebo se nacte znovu pod zamkem
+		return getDirectoryIndex(directory, pIndex);
+	}
+
+	pIndex = &insertDirectoryIndex(directory.start_cluster, std::move(index));
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Zahodi index adresare, napriklad kdyz nemusi odpovidat obsahu na disku.
+ */
+void FatFS::dropDirectoryIndex(int32_t startCluster)
+{
+	auto it = m_directoryIndexes.find(startCluster);
+	if (it != m_directoryIndexes.end())
+	{
+		m_directoryIndexLRU.erase(it->second.lruIt);
+		m_directoryIndexes.erase(it);
+		m_directoryIndexDrops++;
+	}
+}
+
+/**
+ * @brief Najde soubor podle cesty stejne jako FAT::FindFile.
+ * Cesta se resi po jednotlivych castech a kazda uz vyresena cast se bere z cache, takze pri zaplnene cache se z disku
+ * nic necte. Adresare, ktere nejsou v pameti, se ctou z disku s odemcenym zamkem metadat.
+ */
+EStatus FatFS::findFile(const Path & path, FAT::Directory & file, FAT::Directory & parentDirectory, uint32_t & matchCounter,
+                        std::unique_lock<std::mutex> & metadataLock)
+{
+	const std::vector<std::string> & components = path.get();
+
+	matchCounter = 0;
+
+	// root
+	FAT::Directory directory;
+	directory.flags = FileAttributes::DIRECTORY;
+	directory.start_cluster = ROOT_CLUSTER;
+
+	if (components.empty())
+	{
+		file = directory;
+
+		return EStatus::SUCCESS;
+	}
+
+	std::string key;
+	key += path.getDiskLetter();
+	key += ':';
+
+	for (size_t i = 0; i < components.size(); i++)
+	{
+		key += '\\';
+		key += components[i];
+
+		const DentryCache::Entry *pEntry = m_dentryCache.find(key);
+		if (!pEntry)
+		{
+			DentryCache::Entry entry;
+			entry.parent = directory;
+			entry.matchCounter = static_cast<uint32_t>(i);
+
+			FAT::DirectoryIndex *pIndex = nullptr;
+
+			EStatus status = getDirectoryIndex(directory, pIndex, metadataLock);
+			if (status == EStatus::SUCCESS)
+			{
+				status = FAT::FindItem(m_diskNumber, m_bootRecord, m_fatTable, directory, components[i], entry.file,
+				                       pIndex);
+			}
+
+			if (status == EStatus::SUCCESS)
+			{
+				entry.status = EStatus::SUCCESS;
+				entry.matchCounter++;
+			}
+			else if (status == EStatus::FILE_NOT_FOUND)
+			{
+				// negativni polozka
+				entry.status = EStatus::FILE_NOT_FOUND;
+			}
+			else
+			{
+				return status;
+			}
+
+			pEntry = m_dentryCache.insert(key, entry);
+		}
+
+		parentDirectory = pEntry->parent;
+		matchCounter = pEntry->matchCounter;
+
+		if (pEntry->status != EStatus::SUCCESS)
+		{
+			return pEntry->status;
+		}
+
+		if (i == components.size() - 1)
+		{
+			// nalezen hledany soubor
+			file = pEntry->file;
+			break;
+		}
+
+		if (!pEntry->file.isDirectory())
+		{
+			// jeste nejsme na konci cesty, ale byl nalezen file misto adresare
+			return EStatus::INVALID_ARGUMENT;
+		}
+
+		directory = pEntry->file;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @brief Najde soubor pod zamkem metadat, aby bylo mozne zamknout jeho zamek.
+ */
+EStatus FatFS::lookupFile(const Path & path, FAT::Directory & file)
+{
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
+
+	onFATUsed();
+
+	FAT::Directory parentDirectory;
+	uint32_t matchCounter;
+
+	return findFile(path, file, parentDirectory, matchCounter, metadataLock);
+}
+
+EStatus FatFS::init(const kiv_hal::TDrive_Parameters & diskParams)
+{
+	std::unique_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::lock_guard<std::mutex> metadataLock(m_metadataMutex);
+
+	m_diskParams = diskParams;
+
+	// disk uz mozna obsahuje souborovy system FAT
+	EStatus status = loadFAT();
+	if (status != EStatus::SUCCESS)
+	{
+		status = FAT::Init(m_diskNumber, m_diskParams);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		// nove vytvoreny souborovy system je potreba nacist do pameti
+		status = loadFAT();
+	}
+
+	return status;
+}
+
+EStatus FatFS::query(const Path & path, FileInfo *pInfo)
+{
+	std::shared_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
+
+	EStatus status;
+
+	onFATUsed();
+
 	FAT::Directory file;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// najdi soubor
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), file, parentDirectory, matchCounter);
+	status = findFile(path, file, parentDirectory, matchCounter, metadataLock);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
@@ -53,35 +384,46 @@ EStatus FatFS::query(const Path & path, FileInfo *pInfo)
 	return EStatus::SUCCESS;
 }
 
-EStatus FatFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead)
+EStatus FatFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+                    ExtentMap *pExtents)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
-
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
 
 	FAT::Directory file;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// najdi soubor
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), file, parentDirectory, matchCounter);
+	status = lookupFile(path, file);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
+	std::shared_lock<std::shared_timed_mutex> fileLock(getFileLock(file.start_cluster));
+
+	ExtentMap localExtents;
+	ExtentMap & extents = (pExtents) ? *pExtents : localExtents;
+
+	{
+		std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
+
+		// soubor se mohl zmenit, nez jsme ziskali jeho zamek
+		status = findFile(path, file, parentDirectory, matchCounter, metadataLock);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		prepareExtents(file, extents);
+	}
+
 	size_t read = 0;
 
-	// precti soubor
-	status = FAT::ReadFile(m_diskNumber, bootRecord, fatTable.data(), file, buffer, bufferSize, read, offset);
+	// precti soubor, mapa useku uz obsahuje vse potrebne, takze se FAT necte
+	status = FAT::ReadFile(m_diskNumber, m_bootRecord, m_fatTable, file, buffer, bufferSize, read, offset, &extents);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
@@ -97,24 +439,27 @@ EStatus FatFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_t
 
 EStatus FatFS::readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
 
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
+	onFATUsed();
 
 	FAT::Directory directory;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// rozdel fileName na jmena
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), directory, parentDirectory, matchCounter);
+	status = findFile(path, directory, parentDirectory, matchCounter, metadataLock);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	FAT::DirectoryIndex *pIndex = nullptr;
+
+	status = getDirectoryIndex(directory, pIndex, metadataLock);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
@@ -123,7 +468,7 @@ EStatus FatFS::readDir(const Path & path, DirectoryEntry *entries, size_t entryC
 	std::vector<FAT::Directory> items;
 
 	// nacti itemy a vrat vysledek
-	status = FAT::ReadDirectory(m_diskNumber, bootRecord, fatTable.data(), directory, items);
+	status = FAT::ReadDirectory(m_diskNumber, m_bootRecord, m_fatTable, directory, items, pIndex);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
@@ -151,47 +496,105 @@ EStatus FatFS::readDir(const Path & path, DirectoryEntry *entries, size_t entryC
 	return EStatus::SUCCESS;
 }
 
-EStatus FatFS::write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten)
+EStatus FatFS::write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+                     ExtentMap *pExtents)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
-
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
 
 	FAT::Directory file;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// najdi soubor
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), file, parentDirectory, matchCounter);
+	status = lookupFile(path, file);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
-	size_t written = 0;
+	std::unique_lock<std::shared_timed_mutex> fileLock(getFileLock(file.start_cluster));
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
 
-	// zapis
-	status = FAT::WriteFile(m_diskNumber, bootRecord, fatTable.data(), file, buffer, bufferSize, written, offset);
+	// soubor se mohl zmenit, nez jsme ziskali jeho zamek
+	status = findFile(path, file, parentDirectory, matchCounter, metadataLock);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
-	// update zaznamu souboru v parent adresari
-	status = FAT::UpdateFile(m_diskNumber, bootRecord, fatTable.data(), parentDirectory, file.name, file);
+	ExtentMap localExtents;
+	ExtentMap & extents = (pExtents) ? *pExtents : localExtents;
+
+	prepareExtents(file, extents);
+
+	const uint64_t clusterCount = extents.getClusterCount();
+	const uint64_t requiredClusterCount = Util::DivCeil(offset + bufferSize, m_bootRecord.bytes_per_sector
+	                                                                         * m_bootRecord.cluster_size);
+	const uint32_t originalSize = file.size;
+
+	size_t written = 0;
+
+	if (requiredClusterCount > clusterCount)
+	{
+		m_fatTable.beginTransaction();
+
+		// zapis s alokaci clusteru
+		status = FAT::WriteFile(m_diskNumber, m_bootRecord, m_fatTable, file, buffer, bufferSize, written, offset,
+		                        &extents);
+	}
+	else
+	{
+		// zapis do uz alokovanych clusteru FAT nemeni, takze muze probihat soubezne s operacemi nad jinymi soubory
+		metadataLock.unlock();
+
+		status = FAT::WriteFile(m_diskNumber, m_bootRecord, m_fatTable, file, buffer, bufferSize, written, offset,
+		                        &extents);
+
+		metadataLock.lock();
+
+		m_fatTable.beginTransaction();
+	}
+
+	if (status == EStatus::SUCCESS && file.size != originalSize)
+	{
+		FAT::DirectoryIndex *pParentIndex = nullptr;
+
+		status = getDirectoryIndex(parentDirectory, pParentIndex);
+		if (status == EStatus::SUCCESS)
+		{
+			// update zaznamu souboru v parent adresari
+			status = FAT::UpdateFile(m_diskNumber, m_bootRecord, m_fatTable, parentDirectory, file.name, file,
+			                         pParentIndex);
+		}
+	}
+
+	status = finishFATChanges(status);
+
+	if (extents.getClusterCount() != clusterCount)
+	{
+		// soubor se zvetsil, nove clustery uz jsou v nasi mape
+		onChainChanged(file.start_cluster);
+
+		extents.setValidFor(file.start_cluster, getChainVersion(file.start_cluster));
+	}
+
 	if (status != EStatus::SUCCESS)
 	{
+		// zmeny FAT mohly byt vraceny
+		extents.invalidate();
+
+		// zaznam v adresari mohl byt zmenen jen z casti
+		m_dentryCache.removeTree(path.toString());
+		dropDirectoryIndex(parentDirectory.start_cluster);
+
 		return status;
 	}
 
+	// nova velikost souboru
+	m_dentryCache.update(path.toString(), file);
+
 	if (pWritten)
 	{
 		(*pWritten) = written;
@@ -202,7 +605,9 @@ EStatus FatFS::write(const Path & path, const char *buffer, size_t bufferSize, u
 
 EStatus FatFS::create(const Path & path, const FileInfo & info)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	// meni strukturu adresaru nebo retezce clusteru, takze nesmi probihat zadna jina operace
+	std::unique_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
 
 	// kontrola cesty a delky jmena
 	if (path.isEmpty())
@@ -229,14 +634,8 @@ EStatus FatFS::create(const Path & path, const FileInfo & info)
 	}
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
 
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
+	onFATUsed();
 
 	FAT::Directory parentDirectory;
 	FAT::Directory tmp;
@@ -246,7 +645,7 @@ EStatus FatFS::create(const Path & path, const FileInfo & info)
 	// pokud metoda vrati FILE_NOT_FOUND a matchCounter bude roven path.getComponentCount() - 1
 	// vime ze rodicovsky adresar byl nalezen a lze v nem vytvori cilovy soubor
 	// pokud metoda vrati SUCCESS, vime ze cilovy soubor jiz existuje a je treba vratit chybu
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), tmp, parentDirectory, matchCounter);
+	status = findFile(path, tmp, parentDirectory, matchCounter, metadataLock);
 	if (status == EStatus::SUCCESS)
 	{
 		// soubor nebo adresar uz existuje
@@ -257,19 +656,50 @@ EStatus FatFS::create(const Path & path, const FileInfo & info)
 		return status;
 	}
 
+	FAT::DirectoryIndex *pParentIndex = nullptr;
+
+	status = getDirectoryIndex(parentDirectory, pParentIndex);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	m_fatTable.beginTransaction();
+
 	// soubor nenalezen a match counter ma spravnou velikost hodnotu -> nalezen parrent dir
-	status = FAT::CreateFile(m_diskNumber, bootRecord, fatTable.data(), parentDirectory, file);
+	status = FAT::CreateFile(m_diskNumber, m_bootRecord, m_fatTable, parentDirectory, file, pParentIndex);
+
+	status = finishFATChanges(status);
+
+	// negativni polozka pro novy soubor uz neplati
+	// hledani konci u prvni nenalezene casti cesty, takze pod neexistujicim souborem zadne polozky nejsou
+	const std::string key = path.toString();
+	m_dentryCache.remove(key);
+
 	if (status != EStatus::SUCCESS)
 	{
+		// adresar mohl byt zvetsen jen v pameti
+		dropDirectoryIndex(parentDirectory.start_cluster);
+
 		return status;
 	}
 
+	DentryCache::Entry entry;
+	entry.status = EStatus::SUCCESS;
+	entry.file = file;
+	entry.parent = parentDirectory;
+	entry.matchCounter = static_cast<uint32_t>(path.getComponentCount());
+
+	m_dentryCache.insert(key, entry);
+
 	return EStatus::SUCCESS;
 }
 
 EStatus FatFS::resize(const Path & path, uint64_t size)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	// meni strukturu adresaru nebo retezce clusteru, takze nesmi probihat zadna jina operace
+	std::unique_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
 
 	// root nemuzeme resizenout
 	if (path.isEmpty())
@@ -278,39 +708,60 @@ EStatus FatFS::resize(const Path & path, uint64_t size)
 	}
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
 
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
+	onFATUsed();
 
 	FAT::Directory file;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// najdi soubor
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), file, parentDirectory, matchCounter);
+	status = findFile(path, file, parentDirectory, matchCounter, metadataLock);
+	if (status != EStatus::SUCCESS)
+	{
+		return status;
+	}
+
+	FAT::DirectoryIndex *pParentIndex = nullptr;
+
+	status = getDirectoryIndex(parentDirectory, pParentIndex);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
+	m_fatTable.beginTransaction();
+
 	// resize
-	status = FAT::ResizeFile(m_diskNumber, bootRecord, fatTable.data(), parentDirectory, file, size);
+	status = FAT::ResizeFile(m_diskNumber, m_bootRecord, m_fatTable, parentDirectory, file, size, pParentIndex);
+
+	status = finishFATChanges(status);
+
+	onChainChanged(file.start_cluster);
+
+	if (file.isDirectory())
+	{
+		dropDirectoryIndex(file.start_cluster);
+	}
+
 	if (status != EStatus::SUCCESS)
 	{
+		m_dentryCache.removeTree(path.toString());
+		dropDirectoryIndex(parentDirectory.start_cluster);
+
 		return status;
 	}
 
+	m_dentryCache.update(path.toString(), file);
+
 	return EStatus::SUCCESS;
 }
 
 EStatus FatFS::remove(const Path & path)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	// meni strukturu adresaru nebo retezce clusteru, takze nesmi probihat zadna jina operace
+	std::unique_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::unique_lock<std::mutex> metadataLock(m_metadataMutex);
 
 	// root nemuzeme odstranit
 	if (path.isEmpty())
@@ -319,48 +770,72 @@ EStatus FatFS::remove(const Path & path)
 	}
 
 	EStatus status;
-	FAT::BootRecord bootRecord;
-	std::vector<int32_t> fatTable;
 
-	status = FAT::Load(m_diskNumber, m_diskParams, bootRecord, fatTable);
-	if (status != EStatus::SUCCESS)
-	{
-		return status;
-	}
+	onFATUsed();
 
 	FAT::Directory file;
 	FAT::Directory parentDirectory;
 	uint32_t matchCounter;
 
 	// najdi soubor
-	status = FAT::FindFile(m_diskNumber, bootRecord, fatTable.data(), path.get(), file, parentDirectory, matchCounter);
+	status = findFile(path, file, parentDirectory, matchCounter, metadataLock);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
+	FAT::DirectoryIndex *pIndex = nullptr;
+
 	// kontrola, ze adresar je prazdny
 	if (file.isDirectory())
 	{
-		std::vector<FAT::Directory> items;
-
-		status = FAT::ReadDirectory(m_diskNumber, bootRecord, fatTable.data(), file, items);
+		status = getDirectoryIndex(file, pIndex);
 		if (status != EStatus::SUCCESS)
 		{
 			return status;
 		}
 
-		if (!items.empty())
+		if (!pIndex->isEmpty())
 		{
 			return EStatus::DIRECTORY_NOT_EMPTY;
 		}
 	}
 
-	status = FAT::DeleteFile(m_diskNumber, bootRecord, fatTable.data(), parentDirectory, file);
+	status = getDirectoryIndex(parentDirectory, pIndex);
 	if (status != EStatus::SUCCESS)
 	{
 		return status;
 	}
 
+	m_fatTable.beginTransaction();
+
+	const int32_t startCluster = file.start_cluster;
+
+	status = FAT::DeleteFile(m_diskNumber, m_bootRecord, m_fatTable, parentDirectory, file, pIndex);
+
+	status = finishFATChanges(status);
+
+	onChainChanged(startCluster);
+
+	m_dentryCache.removeTree(path.toString());
+
+	if (status != EStatus::SUCCESS)
+	{
+		dropDirectoryIndex(parentDirectory.start_cluster);
+
+		return status;
+	}
+
+	// clustery smazaneho adresare muze dostat jiny soubor
+	dropDirectoryIndex(startCluster);
+
 	return EStatus::SUCCESS;
 }
+
+EStatus FatFS::flush()
+{
+	std::shared_lock<std::shared_timed_mutex> volumeLock(m_volumeLock);
+	std::lock_guard<std::mutex> metadataLock(m_metadataMutex);
+
+	return flushFAT();
+}
@@ -1,34 +1,154 @@
 #pragma once
 
+#include <array>
+#include <list>
+#include <map>
 #include <mutex>
+#include <shared_mutex>
 
 #include "../api/hal.h"  // kiv_hal::TDrive_Parameters
 
 #include "file_system.h"
+#include "fat.h"
+#include "fat_directory_index.h"
+#include "dentry_cache.h"
 
+// maximální počet cest uložených v cache
+#define FATFS_DENTRY_CACHE_CAPACITY  4096
+
+// maximální počet adresářů držených v paměti
+#define FATFS_DIRECTORY_INDEX_CAPACITY  256
+
+// počet zámků souborů, soubory se na ně rozdělují podle prvního clusteru
+#define FATFS_FILE_LOCK_COUNT  64
+
+/**
+ * @brief Souborový systém FAT na jednom disku.
+ *
+ * Zamykání:
+ * - m_volumeLock sdíleně drží všechny operace se soubory, výlučně operace, které mění adresáře nebo délku souborů
+ *   (create, resize, remove).
+ * - Zámek souboru (podle prvního clusteru) drží čtení sdíleně a zápis výlučně, takže čtení a zápisy různých souborů
+ *   mohou probíhat současně.
+ * - m_metadataMutex chrání FAT v paměti, cache cest a adresářů a statistiky. Drží se jen krátce, samotný přenos dat
+ *   souboru probíhá bez něj, pokud zápis nepotřebuje alokovat nové clustery. Bez něj se čtou z disku i adresáře při
+ *   hledání souboru podle cesty.
+ *
+ * Zámky se zamykají vždy v tomto pořadí: m_volumeLock, zámek souboru, m_metadataMutex.
+ */
 class FatFS : public IFileSystem
 {
-	std::mutex m_mutex;
+public:
+	// kdy se změny FAT zapisují na disk
+	enum class EFlushMode
+	{
+		SYNC,     // hned po každé operaci, která FAT změnila
+		DEFERRED  // až při zavření souboru nebo vypnutí systému
+	};
+
+	struct Statistics
+	{
+		uint64_t avoidedFATLoads = 0;    // počet operací, které použily FAT z paměti místo načítání z disku
+		uint64_t fatFlushes = 0;         // počet zápisů změn FAT na disk
+		uint64_t flushedFATSectors = 0;  // celkový počet zapsaných sektorů FAT
+		uint64_t extentMapHits = 0;      // počet čtení a zápisů, které použily mapu úseků z handle souboru
+		uint64_t extentMapBuilds = 0;    // počet sestavení mapy úseků z FAT
+		uint64_t directoryIndexHits = 0; // počet operací, které použily adresář z paměti
+		uint64_t directoryLoads = 0;     // počet načtení adresáře z disku
+		DentryCache::Statistics dentryCache;
+	};
+
+private:
+	struct DirectoryIndexNode
+	{
+		FAT::DirectoryIndex index;
+		std::list<int32_t>::iterator lruIt;
+	};
+
+	std::shared_timed_mutex m_volumeLock;
+	std::array<std::shared_timed_mutex, FATFS_FILE_LOCK_COUNT> m_fileLocks;
+	std::mutex m_metadataMutex;
 	uint8_t m_diskNumber;
+	EFlushMode m_flushMode;
 	kiv_hal::TDrive_Parameters m_diskParams;
+	FAT::BootRecord m_bootRecord;
+	FAT::Table m_fatTable;
+	std::map<int32_t, uint64_t> m_chainVersions;  // verze řetězců clusterů podle prvního clusteru souboru
+	uint64_t m_lastChainVersion;
+	DentryCache m_dentryCache;
+	std::map<int32_t, DirectoryIndexNode> m_directoryIndexes;  // adresáře v paměti podle prvního clusteru
+	std::list<int32_t> m_directoryIndexLRU;                    // nejdéle nepoužitý adresář je na konci
+	uint64_t m_directoryIndexDrops;                            // zvyšuje se při každém zahození adresáře z paměti
+	Statistics m_stats;
+
+	EStatus loadFAT();
+	EStatus flushFAT();
+	void onFATUsed();
+	EStatus finishFATChanges(EStatus status);
+
+	uint64_t getChainVersion(int32_t startCluster) const;
+	void onChainChanged(int32_t startCluster);
+	void prepareExtents(const FAT::Directory & file, ExtentMap & extents);
+
+	FAT::DirectoryIndex *findDirectoryIndex(int32_t startCluster);
+	FAT::DirectoryIndex & insertDirectoryIndex(int32_t startCluster, FAT::DirectoryIndex && index);
+	EStatus getDirectoryIndex(const FAT::Directory & directory, FAT::DirectoryIndex * & pIndex);
+	EStatus getDirectoryIndex(const FAT::Directory & directory, FAT::DirectoryIndex * & pIndex,
+	                          std::unique_lock<std::mutex> & metadataLock);
+	void dropDirectoryIndex(int32_t startCluster);
+
+	EStatus findFile(const Path & path, FAT::Directory & file, FAT::Directory & parentDirectory, uint32_t & matchCounter,
+	                 std::unique_lock<std::mutex> & metadataLock);
+	EStatus lookupFile(const Path & path, FAT::Directory & file);
+
+	std::shared_timed_mutex & getFileLock(int32_t startCluster)
+	{
+		return m_fileLocks[static_cast<uint32_t>(startCluster) % FATFS_FILE_LOCK_COUNT];
+	}
 
 public:
-	FatFS(uint8_t diskNumber)
-	: m_mutex(),
+	FatFS(uint8_t diskNumber, EFlushMode flushMode = EFlushMode::DEFERRED)
+	: m_volumeLock(),
+	  m_fileLocks(),
+	  m_metadataMutex(),
 	  m_diskNumber(diskNumber),
-	  m_diskParams()
+	  m_flushMode(flushMode),
+	  m_diskParams(),
+	  m_bootRecord(),
+	  m_fatTable(),
+	  m_chainVersions(),
+	  m_lastChainVersion(0),
+	  m_dentryCache(FATFS_DENTRY_CACHE_CAPACITY),
+	  m_directoryIndexes(),
+	  m_directoryIndexLRU(),
+	  m_directoryIndexDrops(0),
+	  m_stats()
 	{
 	}
 
 	EStatus init(const kiv_hal::TDrive_Parameters & diskParams);
 
+	Statistics getStatistics()
+	{
+		std::lock_guard<std::mutex> lock(m_metadataMutex);
+
+		Statistics stats = m_stats;
+		stats.dentryCache = m_dentryCache.getStatistics();
+
+		return stats;
+	}
+
 	EStatus query(const Path & path, FileInfo *pInfo) override;
 
-	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead) override;
+	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+	             ExtentMap *pExtents) override;
 	EStatus readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead) override;
-	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten) override;
+	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+	              ExtentMap *pExtents) override;
 
 	EStatus create(const Path & path, const FileInfo & info) override;
 	EStatus resize(const Path & path, uint64_t size) override;
 	EStatus remove(const Path & path) override;
+
+	EStatus flush() override;
 };
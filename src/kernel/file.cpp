@@ -41,7 +41,7 @@ EStatus File::read(char *buffer, size_t bufferSize, size_t *pRead)
 		}
 		else
 		{
-			status = Kernel::GetFileSystem().read(m_path, buffer, bufferSize, m_pos, &read);
+			status = Kernel::GetFileSystem().read(m_path, buffer, bufferSize, m_pos, &read, &m_extents);
 			m_pos += read;
 		}
 	}
@@ -68,8 +68,11 @@ EStatus File::write(const char *buffer, size_t bufferSize, size_t *pWritten)
 
 	if (m_isOpen)
 	{
-		status = Kernel::GetFileSystem().write(m_path, buffer, bufferSize, m_pos, &written);
+		status = Kernel::GetFileSystem().write(m_path, buffer, bufferSize, m_pos, &written, &m_extents);
 		m_pos += written;
+
+		// i neúspěšný zápis mohl změnit FAT
+		m_isModified = true;
 	}
 
 	if (pWritten)
@@ -80,6 +83,24 @@ EStatus File::write(const char *buffer, size_t bufferSize, size_t *pWritten)
 	return status;
 }
 
+void File::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_isOpen && m_isModified)
+	{
+		// odložené změny souborového systému se zapíšou nejpozději při zavření souboru
+		EStatus status = Kernel::GetFileSystem().flush(m_path);
+		if (status != EStatus::SUCCESS)
+		{
+			Kernel::Log("Nelze zapsat zmeny souboru %s: Kod chyby %d", m_path.toString().c_str(),
+			            static_cast<int>(status));
+		}
+	}
+
+	m_isOpen = false;
+}
+
 EStatus File::seek(kiv_os::NFile_Seek command, kiv_os::NFile_Seek base, int64_t offset, uint64_t & result)
 {
 	if (m_info.isDirectory())
@@ -154,6 +175,9 @@ EStatus File::seek(kiv_os::NFile_Seek command, kiv_os::NFile_Seek base, int64_t
 				}
 
 				EStatus resizeStatus = Kernel::GetFileSystem().resize(m_path, newPos);
+
+				m_isModified = true;
+
 				if (resizeStatus != EStatus::SUCCESS)
 				{
 					return resizeStatus;
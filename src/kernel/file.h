@@ -7,6 +7,7 @@
 #include "handle.h"
 #include "path.h"
 #include "types.h"
+#include "extent_map.h"
 
 namespace FileAttributes  // kiv_os::NFile_Attributes
 {
@@ -66,7 +67,9 @@ class File : public IFileHandle
 	uint64_t m_pos;
 	FileInfo m_info;
 	Path m_path;
+	ExtentMap m_extents;  // úseky souboru na disku, sestavuje je souborový systém až při prvním čtení nebo zápisu
 	bool m_isOpen;
+	bool m_isModified;    // přes handle se zapisovalo nebo se měnila velikost souboru
 
 public:
 	File(Path && path, const FileInfo & info)
@@ -74,7 +77,9 @@ public:
 	  m_pos(0),
 	  m_info(info),
 	  m_path(std::move(path)),
-	  m_isOpen(true)
+	  m_extents(),
+	  m_isOpen(true),
+	  m_isModified(false)
 	{
 	}
 
@@ -84,12 +89,7 @@ public:
 		return m_info.isDirectory() ? EFileHandle::DIRECTORY : EFileHandle::REGULAR_FILE;
 	}
 
-	void close() override
-	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-
-		m_isOpen = false;
-	}
+	void close() override;
 
 	EStatus read(char *buffer, size_t bufferSize, size_t *pRead) override;
 	EStatus write(const char *buffer, size_t bufferSize, size_t *pWritten) override;
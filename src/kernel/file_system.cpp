@@ -26,6 +26,9 @@ static std::unique_ptr<IFileSystem> InitFAT(uint8_t diskNumber, const kiv_hal::T
 {
 	std::unique_ptr<FatFS> fat = std::make_unique<FatFS>(diskNumber);
 
+	// disk s FAT bude používat cache sektorů
+	Kernel::GetBlockCache().setSectorSize(diskNumber, diskParams.bytes_per_sector);
+
 	EStatus status = fat->init(diskParams);
 	if (status != EStatus::SUCCESS)
 	{
@@ -59,6 +62,7 @@ void FileSystem::init()
 			if (fs)
 			{
 				m_filesystems[diskLetter] = std::move(fs);
+				m_diskNumbers[diskLetter] = diskNumber;
 
 				if (diskLetter == 'B')
 				{
@@ -87,11 +91,12 @@ EStatus FileSystem::query(const Path & path, FileInfo *pInfo)
 	return (pFileSystem) ? pFileSystem->query(path, pInfo) : EStatus::FILE_NOT_FOUND;
 }
 
-EStatus FileSystem::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead)
+EStatus FileSystem::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+                         ExtentMap *pExtents)
 {
 	IFileSystem *pFileSystem = getFileSystem(path.getDiskLetter());
 
-	return (pFileSystem) ? pFileSystem->read(path, buffer, bufferSize, offset, pRead) : EStatus::FILE_NOT_FOUND;
+	return (pFileSystem) ? pFileSystem->read(path, buffer, bufferSize, offset, pRead, pExtents) : EStatus::FILE_NOT_FOUND;
 }
 
 EStatus FileSystem::readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead)
@@ -101,11 +106,12 @@ EStatus FileSystem::readDir(const Path & path, DirectoryEntry *entries, size_t e
 	return (pFileSystem) ? pFileSystem->readDir(path, entries, entryCount, offset, pRead) : EStatus::FILE_NOT_FOUND;
 }
 
-EStatus FileSystem::write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten)
+EStatus FileSystem::write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+                          ExtentMap *pExtents)
 {
 	IFileSystem *pFileSystem = getFileSystem(path.getDiskLetter());
 
-	return (pFileSystem) ? pFileSystem->write(path, buffer, bufferSize, offset, pWritten) : EStatus::FILE_NOT_FOUND;
+	return (pFileSystem) ? pFileSystem->write(path, buffer, bufferSize, offset, pWritten, pExtents) : EStatus::FILE_NOT_FOUND;
 }
 
 EStatus FileSystem::create(const Path & path, const FileInfo & info)
@@ -128,3 +134,29 @@ EStatus FileSystem::remove(const Path & path)
 
 	return (pFileSystem) ? pFileSystem->remove(path) : EStatus::FILE_NOT_FOUND;
 }
+
+EStatus FileSystem::flush(const Path & path)
+{
+	IFileSystem *pFileSystem = getFileSystem(path.getDiskLetter());
+
+	return (pFileSystem) ? pFileSystem->flush() : EStatus::FILE_NOT_FOUND;
+}
+
+void FileSystem::flushAll()
+{
+	for (auto & fs : m_filesystems)
+	{
+		EStatus status = fs.second->flush();
+		if (status != EStatus::SUCCESS)
+		{
+			Kernel::Log("Nelze zapsat zmeny na disk %c: Kod chyby %d", fs.first, static_cast<int>(status));
+		}
+	}
+
+	// zbytek změn, které jsou zatím jen v cache sektorů
+	EStatus status = Kernel::GetBlockCache().flushAll();
+	if (status != EStatus::SUCCESS)
+	{
+		Kernel::Log("Nelze zapsat cache sektoru na disk: Kod chyby %d", static_cast<int>(status));
+	}
+}
@@ -10,13 +10,19 @@ struct IFileSystem
 {
 	virtual EStatus query(const Path & path, FileInfo *pInfo) = 0;
 
-	virtual EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead) = 0;
+	// pExtents je volitelná mapa úseků souboru, kterou si drží handle souboru mezi jednotlivými operacemi
+	virtual EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+	                     ExtentMap *pExtents) = 0;
 	virtual EStatus readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead) = 0;
-	virtual EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten) = 0;
+	virtual EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+	                      ExtentMap *pExtents) = 0;
 
 	virtual EStatus create(const Path & path, const FileInfo & info) = 0;
 	virtual EStatus resize(const Path & path, uint64_t size) = 0;
 	virtual EStatus remove(const Path & path) = 0;
+
+	// zapíše na disk všechny odložené změny
+	virtual EStatus flush() = 0;
 };
 
 // správce souborových systémů
@@ -26,6 +32,9 @@ class FileSystem
 	// po úvodní inicializaci se už nemění, takže není třeba mutex
 	std::map<char, std::unique_ptr<IFileSystem>> m_filesystems;
 
+	// čísla disků podle písmen, obsahuje jen souborové systémy na discích
+	std::map<char, uint8_t> m_diskNumbers;
+
 	IFileSystem *getFileSystem(char diskLetter) const
 	{
 		auto it = m_filesystems.find(diskLetter);
@@ -42,13 +51,23 @@ public:
 
 	void init();
 
+	const std::map<char, uint8_t> & getDiskNumbers() const
+	{
+		return m_diskNumbers;
+	}
+
 	EStatus query(const Path & path, FileInfo *pInfo = nullptr);
 
-	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead);
+	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+	             ExtentMap *pExtents = nullptr);
 	EStatus readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead);
-	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten);
+	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+	              ExtentMap *pExtents = nullptr);
 
 	EStatus create(const Path & path, const FileInfo & info);
 	EStatus resize(const Path & path, uint64_t size);
 	EStatus remove(const Path & path);
+
+	EStatus flush(const Path & path);
+	void flushAll();
 };
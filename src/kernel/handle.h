@@ -39,4 +39,32 @@ struct IFileHandle : public IHandle
 
 	virtual EStatus read(char *buffer, size_t bufferSize, size_t *pRead) = 0;
 	virtual EStatus write(const char *buffer, size_t bufferSize, size_t *pWritten) = 0;
+
+	// neblokující čtení, které místo čekání na data vrátí EStatus::WOULD_BLOCK
+	// soubory na disku nikdy neblokují, takže jim stačí obyčejné čtení
+	virtual EStatus readNonBlocking(char *buffer, size_t bufferSize, size_t *pRead)
+	{
+		return read(buffer, bufferSize, pRead);
+	}
+
+	// zda čtení nebo zápis nebude blokovat, podle toho soubor signalizuje Event::FILE_READABLE a Event::FILE_WRITABLE
+	virtual bool isReadable()
+	{
+		return true;
+	}
+
+	virtual bool isWritable()
+	{
+		return true;
+	}
+
+	// přihlásí a odhlásí vlákno čekající v EventSystem na připravenost souboru
+	// dokud čeká nějaké vlákno, soubor vyvolá příslušnou událost pokaždé, když se stane připraveným
+	virtual void addReadinessWaiter()
+	{
+	}
+
+	virtual void removeReadinessWaiter()
+	{
+	}
 };
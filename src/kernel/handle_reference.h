@@ -6,15 +6,17 @@ class HandleReference
 {
 	HandleID m_id = 0;
 	IHandle *m_pHandle = nullptr;
+	uint32_t m_generation = 0;  // generace slotu v HandleStorage, odliší handle se stejným ID
 
 	void destroy() noexcept;
 
 public:
 	HandleReference() = default;
 
-	HandleReference(HandleID id, IHandle *pHandle)
+	HandleReference(HandleID id, IHandle *pHandle, uint32_t generation = 0)
 	: m_id(id),
-	  m_pHandle(pHandle)
+	  m_pHandle(pHandle),
+	  m_generation(generation)
 	{
 	}
 
@@ -22,10 +24,12 @@ public:
 
 	HandleReference(HandleReference && other)
 	: m_id(other.m_id),
-	  m_pHandle(other.m_pHandle)
+	  m_pHandle(other.m_pHandle),
+	  m_generation(other.m_generation)
 	{
 		other.m_id = 0;
 		other.m_pHandle = nullptr;
+		other.m_generation = 0;
 	}
 
 	HandleReference & operator=(const HandleReference &) = delete;
@@ -38,9 +42,11 @@ public:
 
 			m_id = other.m_id;
 			m_pHandle = other.m_pHandle;
+			m_generation = other.m_generation;
 
 			other.m_id = 0;
 			other.m_pHandle = nullptr;
+			other.m_generation = 0;
 		}
 
 		return *this;
@@ -60,6 +66,7 @@ public:
 
 		m_id = 0;
 		m_pHandle = nullptr;
+		m_generation = 0;
 	}
 
 	bool isValid() const
@@ -77,6 +84,11 @@ public:
 		return m_id;
 	}
 
+	uint32_t getGeneration() const
+	{
+		return m_generation;
+	}
+
 	IHandle *get() const
 	{
 		return m_pHandle;
@@ -1,139 +1,207 @@
 #include "handle_storage.h"
 
-void HandleStorage::removeRef(HandleID id)
+HandleStorage::HandleStorage()
+: m_blocks(),
+  m_mutex(),
+  m_liveIDs(),
+  m_freeIDs(),
+  m_nextUnusedID(1)  // 0 není platné ID
 {
-	std::unique_lock<std::mutex> lock(m_mutex);
+	for (std::atomic<Block*> & block : m_blocks)
+	{
+		block.store(nullptr, std::memory_order_relaxed);
+	}
+}
 
-	auto it = m_handles.find(id);
-	if (it == m_handles.end())
+HandleStorage::~HandleStorage()
+{
+	// zbylé handle se ruší ještě před uvolněním bloků, protože jejich destruktory mohou uvolňovat další reference
+	for (std::atomic<Block*> & block : m_blocks)
 	{
-		return;
+		Block *pBlock = block.load();
+		if (pBlock)
+		{
+			for (Slot & slot : pBlock->slots)
+			{
+				slot.handle.reset();
+			}
+		}
 	}
 
-	it->second.refCount--;
+	for (std::atomic<Block*> & block : m_blocks)
+	{
+		delete block.exchange(nullptr);
+	}
+}
 
-	std::unique_ptr<IHandle> handle;
+/**
+ * @brief Zvýší počet referencí handle ve slotu, pokud slot obsahuje platný handle.
+ * @param generation Očekávaná generace handle, 0 pro libovolnou.
+ * @return Generace handle, ke kterému byla reference získána, nebo 0, pokud získána nebyla.
+ */
+uint32_t HandleStorage::AddRef(Slot & slot, uint32_t generation)
+{
+	uint64_t state = slot.state.load();
 
-	if (it->second.refCount == 0)
+	do
 	{
-		handle = std::move(it->second.handle);
-		m_handles.erase(it);
+		if ((state & REF_COUNT_MASK) == 0)
+		{
+			return 0;
+		}
+
+		if (generation != 0 && static_cast<uint32_t>(state >> 32) != generation)
+		{
+			// slot už obsahuje jiný handle
+			return 0;
+		}
 	}
+	while (!slot.state.compare_exchange_weak(state, state + 1));
 
-	lock.unlock();
-
-	// zde se zavolá destruktor handle
-	handle.reset();
+	return static_cast<uint32_t>(state >> 32);
 }
 
-HandleReference HandleStorage::addHandle(std::unique_ptr<IHandle> && handle)
+void HandleStorage::removeRef(HandleID id)
 {
-	if (!handle)
+	Slot *pSlot = getSlot(id);
+	if (!pSlot)
 	{
-		return HandleReference();
+		return;
 	}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+	const uint64_t state = pSlot->state.fetch_sub(1) - 1;
 
-	if (m_handles.size() == MAX_HANDLE_COUNT)
+	if ((state & REF_COUNT_MASK) != 0)
 	{
-		return HandleReference();
+		return;
 	}
 
-	do
+	// byla to poslední reference, takže handle už nikdo jiný nemůže získat
+	std::unique_ptr<IHandle> handle = std::move(pSlot->handle);
+
 	{
-		m_lastID++;
-	}
-	while (m_lastID == 0 || m_handles.find(m_lastID) != m_handles.end());
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// na místo odebraného ID se přesune poslední ID
+		const HandleID lastID = m_liveIDs.back();
 
-	const HandleID id = m_lastID;
+		m_liveIDs[pSlot->liveIndex] = lastID;
+		getSlot(lastID)->liveIndex = pSlot->liveIndex;
+		m_liveIDs.pop_back();
 
-	HandleData & data = m_handles[id];
-	data.handle = std::move(handle);
-	data.refCount = 1;
+		m_freeIDs.push(id);
+	}
 
-	return HandleReference(id, data.handle.get());
+	// zde se zavolá destruktor handle
+	handle.reset();
 }
 
-HandleReference HandleStorage::getHandle(HandleID id)
+HandleReference HandleStorage::addHandle(std::unique_ptr<IHandle> && handle)
 {
-	if (!id)
+	if (!handle)
 	{
 		return HandleReference();
 	}
 
 	std::lock_guard<std::mutex> lock(m_mutex);
 
-	auto it = m_handles.find(id);
-	if (it == m_handles.end())
+	HandleID id;
+
+	if (m_nextUnusedID <= MAX_HANDLE_COUNT)
 	{
-		return HandleReference();
-	}
+		id = static_cast<HandleID>(m_nextUnusedID);
 
-	it->second.refCount++;
+		std::atomic<Block*> & block = m_blocks[id / HANDLE_STORAGE_BLOCK_SIZE];
 
-	return HandleReference(it->first, it->second.handle.get());
-}
+		if (!block.load(std::memory_order_relaxed))
+		{
+			block.store(new Block(), std::memory_order_release);
+		}
 
-HandleReference HandleStorage::getHandleOfType(HandleID id, EHandle type)
-{
-	if (!id)
+		m_nextUnusedID++;
+	}
+	else if (!m_freeIDs.empty())
+	{
+		id = m_freeIDs.front();
+		m_freeIDs.pop();
+	}
+	else
 	{
 		return HandleReference();
 	}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+	Slot & slot = *getSlot(id);
+
+	slot.handle = std::move(handle);
 
-	auto it = m_handles.find(id);
-	if (it == m_handles.end() || it->second.handle->getHandleType() != type)
+	uint32_t generation = static_cast<uint32_t>(slot.state.load() >> 32) + 1;
+	if (generation == 0)
 	{
-		return HandleReference();
+		// generace 0 znamená libovolnou generaci
+		generation = 1;
 	}
 
-	it->second.refCount++;
+	// nová generace s jednou referencí, teprve tím je handle viditelný pro vyhledávání
+	slot.state.store((static_cast<uint64_t>(generation) << 32) | 1);
+
+	slot.liveIndex = m_liveIDs.size();
+	m_liveIDs.push_back(id);
 
-	return HandleReference(it->first, it->second.handle.get());
+	return HandleReference(id, slot.handle.get(), generation);
 }
 
-bool HandleStorage::hasHandle(HandleID id)
+HandleReference HandleStorage::getHandle(HandleID id)
+{
+	return getHandle(id, 0);
+}
+
+HandleReference HandleStorage::getHandle(HandleID id, uint32_t generation)
 {
 	if (!id)
 	{
-		return false;
+		return HandleReference();
 	}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+	Slot *pSlot = getSlot(id);
+	if (!pSlot)
+	{
+		return HandleReference();
+	}
 
-	auto it = m_handles.find(id);
-	if (it == m_handles.end())
+	generation = AddRef(*pSlot, generation);
+	if (generation == 0)
 	{
-		return false;
+		return HandleReference();
 	}
 
-	return true;
+	return HandleReference(id, pSlot->handle.get(), generation);
 }
 
-bool HandleStorage::hasHandleOfType(HandleID id, EHandle type)
+HandleReference HandleStorage::getHandleOfType(HandleID id, EHandle type)
 {
-	if (!id)
+	HandleReference handle = getHandle(id);
+
+	if (handle && handle->getHandleType() != type)
 	{
-		return false;
+		handle.release();
 	}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+	return handle;
+}
 
-	auto it = m_handles.find(id);
-	if (it == m_handles.end() || it->second.handle->getHandleType() != type)
+bool HandleStorage::hasHandle(HandleID id)
+{
+	if (!id)
 	{
 		return false;
 	}
 
-	return true;
+	Slot *pSlot = getSlot(id);
+
+	return pSlot && (pSlot->state.load() & REF_COUNT_MASK) != 0;
 }
 
-size_t HandleStorage::getHandleCount()
+bool HandleStorage::hasHandleOfType(HandleID id, EHandle type)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
-
-	return m_handles.size();
+	return static_cast<bool>(getHandleOfType(id, type));
 }
@@ -1,59 +1,129 @@
 #pragma once
 
-#include <map>
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <memory>
+#include <queue>
 #include <vector>
 
 #include "handle_reference.h"
 
+// počet slotů v jednom bloku tabulky handle, bloky se alokují až podle potřeby
+#define HANDLE_STORAGE_BLOCK_SIZE  256
+
+/**
+ * @brief Tabulka všech handle v systému.
+ * Handle jsou ve slotech indexovaných přímo jejich ID, takže vyhledání handle a změna počtu referencí jsou bez zámku.
+ * Zámek se zamyká jen při přidělení a uvolnění slotu a při procházení všech handle.
+ * Stav slotu obsahuje kromě počtu referencí i generaci, která se zvýší při každém novém použití slotu. Reference na
+ * handle nese jeho generaci. Vyhledání se zadanou generací tak uspěje jen pro stejný handle, i když bylo jeho ID mezitím
+ * přiděleno jinému handle. Vyhledání pouze podle ID generaci nekontroluje, používá se jen pro ID, jejichž handle
+ * volající zaručeně drží.
+ */
 class HandleStorage
 {
-	struct HandleData
+	struct Slot
+	{
+		std::atomic<uint64_t> state;      // generace v horních 32 bitech, počet referencí v dolních 32 bitech
+		std::unique_ptr<IHandle> handle;  // platný, jen dokud je počet referencí nenulový
+		size_t liveIndex;                 // pozice ID v m_liveIDs, chráněná m_mutex
+
+		Slot()
+		: state(0),
+		  handle(),
+		  liveIndex(0)
+		{
+		}
+	};
+
+	struct Block
 	{
-		std::unique_ptr<IHandle> handle;
-		uint32_t refCount;
+		std::array<Slot, HANDLE_STORAGE_BLOCK_SIZE> slots;
 	};
 
-	std::map<HandleID, HandleData> m_handles;
-	std::mutex m_mutex;
-	HandleID m_lastID = 0;
+	static constexpr uint64_t REF_COUNT_MASK = 0xFFFFFFFF;
+	static constexpr size_t BLOCK_COUNT = (MAX_HANDLE_COUNT + 1) / HANDLE_STORAGE_BLOCK_SIZE;
+
+	std::array<std::atomic<Block*>, BLOCK_COUNT> m_blocks;
+	std::mutex m_mutex;              // chrání přidělování slotů a m_liveIDs
+	std::vector<HandleID> m_liveIDs; // ID všech platných handle, aby jejich procházení nezáviselo na velikosti tabulky
+	std::queue<HandleID> m_freeIDs;  // uvolněná ID v pořadí uvolnění, aby se každé ID znovu použilo co nejpozději
+	uint32_t m_nextUnusedID;         // ID od této hodnoty výše ještě nebyla nikdy přidělena
+
+	Slot *getSlot(HandleID id) const
+	{
+		Block *pBlock = m_blocks[id / HANDLE_STORAGE_BLOCK_SIZE].load(std::memory_order_acquire);
+
+		return (pBlock) ? &pBlock->slots[id % HANDLE_STORAGE_BLOCK_SIZE] : nullptr;
+	}
+
+	static uint32_t AddRef(Slot & slot, uint32_t generation);
 
 	void removeRef(HandleID id);
 
 	friend class HandleReference;
 
 public:
-	HandleStorage() = default;
+	HandleStorage();
+	~HandleStorage();
+
+	HandleStorage(const HandleStorage &) = delete;
+	HandleStorage & operator=(const HandleStorage &) = delete;
 
 	HandleReference addHandle(std::unique_ptr<IHandle> && handle);
 
 	HandleReference getHandle(HandleID id);
 	HandleReference getHandleOfType(HandleID id, EHandle type);
 
+	/**
+	 * @brief Vrátí handle s daným ID, pouze pokud je to stále handle dané generace.
+	 */
+	HandleReference getHandle(HandleID id, uint32_t generation);
+
 	bool hasHandle(HandleID id);
 	bool hasHandleOfType(HandleID id, EHandle type);
 
 	template<class Predicate>
 	std::vector<HandleReference> getHandles(Predicate predicate)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<HandleReference> handles;
 
-		std::vector<HandleReference> result;
-		for (auto it = m_handles.begin(); it != m_handles.end(); ++it)
 		{
-			const HandleID id = it->first;
-			const IHandle *pHandle = it->second.handle.get();
+			std::lock_guard<std::mutex> lock(m_mutex);
 
-			if (predicate(id, pHandle))
+			handles.reserve(m_liveIDs.size());
+
+			for (HandleID id : m_liveIDs)
 			{
-				it->second.refCount++;
-				result.emplace_back(id, it->second.handle.get());
+				Slot & slot = *getSlot(id);
+
+				const uint32_t generation = AddRef(slot, 0);
+				if (generation != 0)
+				{
+					handles.emplace_back(id, slot.handle.get(), generation);
+				}
+			}
+		}
+
+		// predikát se volá bez zámku, protože uvolnění nevybraných handle zámek zamyká
+		std::vector<HandleReference> result;
+
+		for (HandleReference & handle : handles)
+		{
+			if (predicate(handle.getID(), handle.get()))
+			{
+				result.emplace_back(std::move(handle));
 			}
 		}
 
 		return result;
 	}
 
-	size_t getHandleCount();
+	size_t getHandleCount()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		return m_liveIDs.size();
+	}
 };
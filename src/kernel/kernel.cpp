@@ -42,4 +42,7 @@ void __stdcall Bootstrap_Loader(kiv_hal::TRegisters &)
 
 	// předání řízení shellu
 	RunShell();
+
+	// systém se vypíná, takže je potřeba zapsat všechny odložené změny na disky
+	Kernel::GetFileSystem().flushAll();
 }
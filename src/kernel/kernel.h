@@ -7,6 +7,8 @@
 #include "dll.h"
 #include "handle_storage.h"
 #include "event_system.h"
+#include "disk_statistics.h"
+#include "block_cache.h"
 #include "file_system.h"
 #include "console.h"
 #include "compiler.h"
@@ -16,6 +18,8 @@ class Kernel
 	DLL m_userDLL;
 	HandleStorage m_handleStorage;
 	EventSystem m_eventSystem;
+	DiskStatistics m_diskStatistics;
+	BlockCache m_blockCache;  // musí zaniknout až po souborových systémech
 	FileSystem m_fileSystem;
 	HandleReference m_consoleHandle;
 
@@ -26,6 +30,8 @@ public:
 	: m_userDLL(),
 	  m_handleStorage(),
 	  m_eventSystem(),
+	  m_diskStatistics(),
+	  m_blockCache(),
 	  m_fileSystem(),
 	  m_consoleHandle()
 	{
@@ -44,6 +50,16 @@ public:
 		return s_pInstance->m_eventSystem;
 	}
 
+	static DiskStatistics & GetDiskStatistics()
+	{
+		return s_pInstance->m_diskStatistics;
+	}
+
+	static BlockCache & GetBlockCache()
+	{
+		return s_pInstance->m_blockCache;
+	}
+
 	static FileSystem & GetFileSystem()
 	{
 		return s_pInstance->m_fileSystem;
@@ -1,11 +1,26 @@
+#include <algorithm>  // std::min
 #include <cstring>  // std::memcpy
 
 #include "pipe.h"
 #include "kernel.h"
 
-bool Pipe::Create(HandleReference & readEnd, HandleReference & writeEnd)
+// chrání PipeWriteEnd::m_pReadEnd při zjišťování připravenosti zapisovacího konce
+// EventSystem se ptá na připravenost se svým zámkem, takže tam nelze zamykat mutex zapisovacího konce, který je zamčený
+// i během vyvolávání událostí
+static std::mutex g_readinessMutex;
+
+bool Pipe::Create(HandleReference & readEnd, HandleReference & writeEnd, size_t capacity)
 {
-	HandleReference readEndHandle = Kernel::GetHandleStorage().addHandle(std::make_unique<PipeReadEnd>());
+	if (capacity == 0)
+	{
+		capacity = PIPE_DEFAULT_CAPACITY;
+	}
+	else if (capacity > PIPE_MAX_CAPACITY)
+	{
+		capacity = PIPE_MAX_CAPACITY;
+	}
+
+	HandleReference readEndHandle = Kernel::GetHandleStorage().addHandle(std::make_unique<PipeReadEnd>(capacity));
 	if (!readEndHandle)
 	{
 		return false;
@@ -18,6 +33,8 @@ bool Pipe::Create(HandleReference & readEnd, HandleReference & writeEnd)
 	}
 
 	readEndHandle.as<PipeReadEnd>()->m_pWriteEnd = writeEndHandle.as<PipeWriteEnd>();
+	readEndHandle.as<PipeReadEnd>()->m_id = readEndHandle.getID();
+	readEndHandle.as<PipeReadEnd>()->m_writeEndID = writeEndHandle.getID();
 	writeEndHandle.as<PipeWriteEnd>()->m_pReadEnd = readEndHandle.as<PipeReadEnd>();
 
 	readEnd = std::move(readEndHandle);
@@ -26,64 +43,143 @@ bool Pipe::Create(HandleReference & readEnd, HandleReference & writeEnd)
 	return true;
 }
 
-size_t PipeReadEnd::push(const char *data, size_t dataLength)
+void PipeReadEnd::wakeReader()
 {
-	std::unique_lock<std::mutex> lock(m_mutex);
+	// zámek zajistí, že čtecí vlákno nepropadne mezi kontrolou bufferu a začátkem čekání
+	std::lock_guard<std::mutex> lock(m_mutex);
 
+	m_readerCV.notify_one();
+}
+
+void PipeReadEnd::wakeWriter()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_writerCV.notify_one();
+}
+
+/**
+ * @brief Zapíše data do bufferu roury.
+ * @param producer Funkce (char *buffer, size_t length, size_t offset), která zapíše nejvýše length bajtů do souvislé
+ * části bufferu a vrátí jejich počet. Offset je počet bajtů, které už byly zapsány. Méně bajtů zápis ukončí.
+ * @return Počet zapsaných bajtů nebo 0, pokud byl čtecí konec roury uzavřen.
+ */
+template<class Producer>
+size_t PipeReadEnd::push(size_t dataLength, Producer producer)
+{
 	size_t writtenLength = 0;
 
 	while (writtenLength < dataLength)
 	{
-		while (m_isFull)
+		const uint64_t writeCount = m_writeCount.load(std::memory_order_relaxed);
+
+		size_t freeLength = m_capacity - static_cast<size_t>(writeCount - m_readCount.load(std::memory_order_acquire));
+
+		if (freeLength == 0)
 		{
-			if (m_pWriteEnd)
+			// buffer je plný, takže probudíme čtecí vlákno a počkáme, až zaplnění klesne na dolní mez
+			if (m_isReaderWaiting)
 			{
-				m_cv.notify_one();  // probudíme čtecí vlákno
-				m_cv.wait(lock);
+				wakeReader();
 			}
-			else
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_isWriterWaiting = true;
+
+			while (getDataLength() > getLowWatermark())
 			{
-				return 0;
+				if (!m_pWriteEnd)
+				{
+					m_isWriterWaiting = false;
+					return 0;
+				}
+
+				m_writerCV.wait(lock);
 			}
+
+			m_isWriterWaiting = false;
+
+			continue;
 		}
 
-		size_t length = (m_writerPos >= m_readerPos) ? m_buffer.size() - m_writerPos : m_readerPos - m_writerPos;
+		const size_t writerPos = static_cast<size_t>(writeCount % m_capacity);
+
+		size_t length = std::min(m_capacity - writerPos, freeLength);
 
 		if ((length + writtenLength) > dataLength)
 		{
 			length = dataLength - writtenLength;
 		}
 
-		std::memcpy(m_buffer.data() + m_writerPos, data + writtenLength, length);
+		const size_t producedLength = producer(m_buffer.get() + writerPos, length, writtenLength);
 
-		writtenLength += length;
+		writtenLength += producedLength;
+
+		m_writeCount.store(writeCount + producedLength);
+
+		if (m_readinessWaiters > 0)
+		{
+			Kernel::GetEventSystem().dispatchEvent(Event::FILE_READABLE, m_id);
+		}
 
-		m_writerPos += length;
-		if (m_writerPos >= m_buffer.size())
+		// čtecí vlákno probudíme už během zápisu, jen pokud buffer překročil horní mez zaplnění
+		if (m_isReaderWaiting && getDataLength() >= getHighWatermark())
 		{
-			m_writerPos = 0;
+			wakeReader();
 		}
 
-		if (m_writerPos == m_readerPos)
+		if (producedLength < length)
 		{
-			m_isFull = true;
+			break;
 		}
 	}
 
-	lock.unlock();
-	m_cv.notify_one();
+	if (m_isReaderWaiting && getDataLength() > 0)
+	{
+		wakeReader();  // zápis skončil, takže čtecí vlákno dostane i data pod horní mezí
+	}
 
 	return writtenLength;
 }
 
+size_t PipeReadEnd::push(const char *data, size_t dataLength)
+{
+	return push(dataLength, [data](char *buffer, size_t length, size_t offset) -> size_t
+	{
+		std::memcpy(buffer, data + offset, length);
+		return length;
+	});
+}
+
+size_t PipeReadEnd::pushFrom(IFileHandle & source, size_t dataLength, EStatus & status)
+{
+	status = EStatus::SUCCESS;
+
+	return push(dataLength, [&source, &status](char *buffer, size_t length, size_t) -> size_t
+	{
+		size_t read = 0;
+		status = source.read(buffer, length, &read);
+
+		return (status == EStatus::SUCCESS) ? read : 0;
+	});
+}
+
 void PipeReadEnd::onWriteEndClosed()
 {
 	std::unique_lock<std::mutex> lock(m_mutex);
 
 	m_pWriteEnd = nullptr;
+	m_isWriteEndClosed = true;
 
 	lock.unlock();
-	m_cv.notify_one();  // někdo uzavřel zapisovací konec roury, takže probudíme čtecí vlákno čekající na další data
+	m_readerCV.notify_all();  // někdo uzavřel zapisovací konec roury, takže probudíme čtecí vlákno čekající na další data
+
+	// uzavřená roura je připravená ke čtení, čtení už vrátí konec dat
+	if (m_readinessWaiters > 0)
+	{
+		Kernel::GetEventSystem().dispatchEvent(Event::FILE_READABLE, m_id);
+	}
 }
 
 void PipeReadEnd::close()
@@ -104,13 +200,102 @@ void PipeReadEnd::close()
 	}
 
 	lock.unlock();
-	m_cv.notify_one();
+	m_writerCV.notify_all();
+
+	if (m_writeEndReadinessWaiters > 0)
+	{
+		Kernel::GetEventSystem().dispatchEvent(Event::FILE_WRITABLE, m_writeEndID);
+	}
 }
 
-EStatus PipeReadEnd::read(char *buffer, size_t bufferSize, size_t *pRead)
+bool PipeReadEnd::isReadable()
+{
+	return m_isClosed || m_isWriteEndClosed || getDataLength() > 0;
+}
+
+/**
+ * @brief Počká, až budou v bufferu nějaká data.
+ * Musí se volat se zamčeným m_readerMutex.
+ * @return False, pokud je buffer prázdný a zapisovací konec roury je uzavřen, jinak true.
+ */
+bool PipeReadEnd::waitForData()
 {
+	if (getDataLength() > 0)
+	{
+		return true;
+	}
+
 	std::unique_lock<std::mutex> lock(m_mutex);
 
+	m_isReaderWaiting = true;
+
+	while (getDataLength() == 0)
+	{
+		if (!m_pWriteEnd)
+		{
+			m_isReaderWaiting = false;
+			return false;
+		}
+
+		m_readerCV.wait(lock);
+	}
+
+	m_isReaderWaiting = false;
+
+	return true;
+}
+
+/**
+ * @brief Přečte data, která už jsou v bufferu roury.
+ * Musí se volat se zamčeným m_readerMutex.
+ * @param consumer Funkce (const char *data, size_t length, size_t offset), která zpracuje nejvýše length bajtů ze
+ * souvislé části bufferu a vrátí jejich počet. Offset je počet bajtů, které už byly zpracovány. Méně bajtů čtení ukončí.
+ * @return Počet přečtených bajtů.
+ */
+template<class Consumer>
+size_t PipeReadEnd::pop(size_t bufferSize, Consumer consumer)
+{
+	const uint64_t readCount = m_readCount.load(std::memory_order_relaxed);
+
+	size_t dataLength = static_cast<size_t>(m_writeCount.load(std::memory_order_acquire) - readCount);
+
+	if (dataLength > bufferSize)
+	{
+		dataLength = bufferSize;
+	}
+
+	const size_t readerPos = static_cast<size_t>(readCount % m_capacity);
+	const size_t firstPartLength = std::min(m_capacity - readerPos, dataLength);
+
+	size_t readLength = consumer(m_buffer.get() + readerPos, firstPartLength, 0);
+
+	if (readLength == firstPartLength && dataLength > firstPartLength)
+	{
+		readLength += consumer(m_buffer.get(), dataLength - firstPartLength, firstPartLength);
+	}
+
+	m_readCount.store(readCount + readLength);
+
+	if (m_writeEndReadinessWaiters > 0)
+	{
+		Kernel::GetEventSystem().dispatchEvent(Event::FILE_WRITABLE, m_writeEndID);
+	}
+
+	// zapisovací vlákno čeká na pokles zaplnění na dolní mez
+	if (m_isWriterWaiting && getDataLength() <= getLowWatermark())
+	{
+		wakeWriter();
+	}
+
+	return readLength;
+}
+
+EStatus PipeReadEnd::read(char *buffer, size_t bufferSize, size_t *pRead)
+{
+	std::lock_guard<std::mutex> readerLock(m_readerMutex);
+
+	size_t readLength = 0;
+
 	if (m_isClosed)
 	{
 		if (pRead)
@@ -121,61 +306,108 @@ EStatus PipeReadEnd::read(char *buffer, size_t bufferSize, size_t *pRead)
 		return EStatus::INVALID_ARGUMENT;
 	}
 
-	while (m_readerPos == m_writerPos && !m_isFull)  // buffer je prázdný
+	if (waitForData())
 	{
-		if (m_pWriteEnd)
+		readLength = pop(bufferSize, [buffer](const char *data, size_t length, size_t offset) -> size_t
 		{
-			m_cv.wait(lock);
-		}
-		else
+			std::memcpy(buffer + offset, data, length);
+			return length;
+		});
+	}
+
+	if (pRead)
+	{
+		(*pRead) = readLength;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+EStatus PipeReadEnd::readNonBlocking(char *buffer, size_t bufferSize, size_t *pRead)
+{
+	std::lock_guard<std::mutex> readerLock(m_readerMutex);
+
+	if (m_isClosed)
+	{
+		if (pRead)
 		{
-			if (pRead)
-			{
-				(*pRead) = 0;
-			}
+			(*pRead) = 0;
+		}
+
+		return EStatus::INVALID_ARGUMENT;
+	}
 
-			return EStatus::SUCCESS;
+	if (getDataLength() == 0 && !m_isWriteEndClosed)
+	{
+		if (pRead)
+		{
+			(*pRead) = 0;
 		}
+
+		return EStatus::WOULD_BLOCK;
 	}
 
+	// po uzavření zapisovacího konce se přečte zbytek dat, nebo nic, což znamená konec dat
+	const size_t readLength = pop(bufferSize, [buffer](const char *data, size_t length, size_t offset) -> size_t
+	{
+		std::memcpy(buffer + offset, data, length);
+		return length;
+	});
+
+	if (pRead)
+	{
+		(*pRead) = readLength;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+EStatus PipeReadEnd::readTo(IFileHandle & destination, size_t length, size_t *pRead, bool *pIsDestinationError)
+{
+	std::lock_guard<std::mutex> readerLock(m_readerMutex);
+
 	size_t readLength = 0;
+	EStatus status = EStatus::SUCCESS;
 
-	while ((m_readerPos != m_writerPos || m_isFull) && readLength < bufferSize)
 	{
-		size_t length = (m_readerPos < m_writerPos) ? m_writerPos - m_readerPos : m_buffer.size() - m_readerPos;
+		std::lock_guard<std::mutex> lock(m_mutex);
 
-		if ((length + readLength) > bufferSize)
+		if (m_isClosed || &destination == m_pWriteEnd)
 		{
-			length = bufferSize - readLength;
+			// přesun z roury do ní samotné by čekal sám na sebe
+			status = EStatus::INVALID_ARGUMENT;
 		}
+	}
 
-		std::memcpy(buffer + readLength, m_buffer.data() + m_readerPos, length);
+	if (status == EStatus::SUCCESS && waitForData())
+	{
+		readLength = pop(length, [&destination, &status](const char *data, size_t dataLength, size_t) -> size_t
+		{
+			size_t written = 0;
+			status = destination.write(data, dataLength, &written);
 
-		readLength += length;
+			return (status == EStatus::SUCCESS) ? written : 0;
+		});
 
-		m_readerPos += length;
-		if (m_readerPos >= m_buffer.size())
+		// po úspěšném čekání na data může selhat jen zápis do cíle
+		if (status != EStatus::SUCCESS && pIsDestinationError)
 		{
-			m_readerPos = 0;
+			(*pIsDestinationError) = true;
 		}
-
-		m_isFull = false;
 	}
 
-	lock.unlock();
-	m_cv.notify_one();
-
 	if (pRead)
 	{
 		(*pRead) = readLength;
 	}
 
-	return EStatus::SUCCESS;
+	return status;
 }
 
 void PipeWriteEnd::onReadEndClosed()
 {
 	std::lock_guard<std::mutex> lock(m_mutex);
+	std::lock_guard<std::mutex> readinessLock(g_readinessMutex);
 
 	m_pReadEnd = nullptr;
 }
@@ -187,10 +419,41 @@ void PipeWriteEnd::close()
 	if (m_pReadEnd)
 	{
 		m_pReadEnd->onWriteEndClosed();
+
+		std::lock_guard<std::mutex> readinessLock(g_readinessMutex);
+
 		m_pReadEnd = nullptr;
 	}
 }
 
+bool PipeWriteEnd::isWritable()
+{
+	std::lock_guard<std::mutex> readinessLock(g_readinessMutex);
+
+	// do roury s uzavřeným čtecím koncem zápis selže hned
+	return !m_pReadEnd || m_pReadEnd->getDataLength() < m_pReadEnd->m_capacity;
+}
+
+void PipeWriteEnd::addReadinessWaiter()
+{
+	std::lock_guard<std::mutex> readinessLock(g_readinessMutex);
+
+	if (m_pReadEnd)
+	{
+		m_pReadEnd->m_writeEndReadinessWaiters++;
+	}
+}
+
+void PipeWriteEnd::removeReadinessWaiter()
+{
+	std::lock_guard<std::mutex> readinessLock(g_readinessMutex);
+
+	if (m_pReadEnd)
+	{
+		m_pReadEnd->m_writeEndReadinessWaiters--;
+	}
+}
+
 EStatus PipeWriteEnd::write(const char *buffer, size_t bufferSize, size_t *pWritten)
 {
 	std::lock_guard<std::mutex> lock(m_mutex);
@@ -214,3 +477,33 @@ EStatus PipeWriteEnd::write(const char *buffer, size_t bufferSize, size_t *pWrit
 
 	return EStatus::SUCCESS;
 }
+
+EStatus PipeWriteEnd::writeFrom(IFileHandle & source, size_t length, size_t *pWritten, bool *pIsDestinationError)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_pReadEnd && pIsDestinationError)
+	{
+		(*pIsDestinationError) = true;
+	}
+
+	if (!m_pReadEnd || &source == m_pReadEnd)
+	{
+		if (pWritten)
+		{
+			(*pWritten) = 0;
+		}
+
+		return EStatus::INVALID_ARGUMENT;
+	}
+
+	EStatus status;
+	size_t writtenLength = m_pReadEnd->pushFrom(source, length, status);
+
+	if (pWritten)
+	{
+		(*pWritten) = writtenLength;
+	}
+
+	return status;
+}
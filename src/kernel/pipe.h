@@ -1,37 +1,113 @@
 #pragma once
 
-#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 
 #include "handle_reference.h"
 
+// výchozí kapacita roury v bajtech
+#define PIPE_DEFAULT_CAPACITY  (64 * 1024)
+// největší kapacita roury v bajtech, kterou lze vyžádat
+#define PIPE_MAX_CAPACITY  (16 * 1024 * 1024)
+
 namespace Pipe
 {
-	bool Create(HandleReference & readEnd, HandleReference & writeEnd);
+	/**
+	 * @brief Vytvoří rouru.
+	 * @param capacity Kapacita roury v bajtech. Nula znamená PIPE_DEFAULT_CAPACITY, větší hodnota než PIPE_MAX_CAPACITY
+	 * se omezí.
+	 */
+	bool Create(HandleReference & readEnd, HandleReference & writeEnd, size_t capacity = 0);
 }
 
 class PipeWriteEnd;
 
+/**
+ * @brief Čtecí konec roury, který zároveň vlastní její buffer.
+ * Buffer je kruhový s jedním zapisovacím a jedním čtecím vláknem, které si předávají data bez zámku jen pomocí
+ * atomických pozic. Zámek m_mutex se zamyká jen při čekání na prázdný nebo plný buffer a při uzavírání roury.
+ * Souběžné zápisy serializuje PipeWriteEnd a souběžná čtení m_readerMutex.
+ */
 class PipeReadEnd : public IFileHandle
 {
-	std::array<char, 1024> m_buffer;
-	size_t m_readerPos = 0;
-	size_t m_writerPos = 0;
-	bool m_isFull = false;
-	bool m_isClosed = false;
+	std::unique_ptr<char[]> m_buffer;
+	size_t m_capacity;
+	std::atomic<uint64_t> m_readCount;   // celkový počet přečtených bajtů, mění ho jen čtecí vlákno
+	std::atomic<uint64_t> m_writeCount;  // celkový počet zapsaných bajtů, mění ho jen zapisovací vlákno
+	std::atomic<bool> m_isReaderWaiting;
+	std::atomic<bool> m_isWriterWaiting;
+	std::atomic<bool> m_isClosed;
+	std::atomic<bool> m_isWriteEndClosed;
+	std::atomic<unsigned int> m_readinessWaiters;          // vlákna čekající na Event::FILE_READABLE tohoto konce
+	std::atomic<unsigned int> m_writeEndReadinessWaiters;  // vlákna čekající na Event::FILE_WRITABLE zapisovacího konce
+	HandleID m_id = 0;
+	HandleID m_writeEndID = 0;
+	std::mutex m_readerMutex;
 	std::mutex m_mutex;
-	std::condition_variable m_cv;
+	std::condition_variable m_readerCV;  // čtecí vlákno čekající na data
+	std::condition_variable m_writerCV;  // zapisovací vlákno čekající na volné místo
 	PipeWriteEnd *m_pWriteEnd = nullptr;
 
+	template<class Producer>
+	size_t push(size_t dataLength, Producer producer);
 	size_t push(const char *data, size_t dataLength);
+	size_t pushFrom(IFileHandle & source, size_t dataLength, EStatus & status);
+
+	bool waitForData();
+	template<class Consumer>
+	size_t pop(size_t bufferSize, Consumer consumer);
+
 	void onWriteEndClosed();
+	void wakeReader();
+	void wakeWriter();
+
+	/**
+	 * @brief Vrátí počet bajtů v bufferu.
+	 */
+	size_t getDataLength() const
+	{
+		return static_cast<size_t>(m_writeCount.load() - m_readCount.load());
+	}
+
+	/**
+	 * @brief Horní mez zaplnění bufferu, po jejímž překročení zapisovací vlákno probudí čekající čtecí vlákno.
+	 */
+	size_t getHighWatermark() const
+	{
+		return m_capacity / 2;
+	}
+
+	/**
+	 * @brief Dolní mez zaplnění bufferu, po jejímž dosažení čtecí vlákno probudí čekající zapisovací vlákno.
+	 */
+	size_t getLowWatermark() const
+	{
+		return m_capacity / 4;
+	}
 
 	friend class PipeWriteEnd;
-	friend bool Pipe::Create(HandleReference &, HandleReference &);
+	friend bool Pipe::Create(HandleReference &, HandleReference &, size_t);
 
 public:
-	PipeReadEnd() = default;
+	explicit PipeReadEnd(size_t capacity)
+	: m_buffer(std::make_unique<char[]>(capacity)),
+	  m_capacity(capacity),
+	  m_readCount(0),
+	  m_writeCount(0),
+	  m_isReaderWaiting(false),
+	  m_isWriterWaiting(false),
+	  m_isClosed(false),
+	  m_isWriteEndClosed(false),
+	  m_readinessWaiters(0),
+	  m_writeEndReadinessWaiters(0),
+	  m_readerMutex(),
+	  m_mutex(),
+	  m_readerCV(),
+	  m_writerCV()
+	{
+	}
 
 	PipeReadEnd(const PipeReadEnd &) = delete;
 	PipeReadEnd(PipeReadEnd &&) = delete;
@@ -52,6 +128,32 @@ public:
 	void close() override;
 
 	EStatus read(char *buffer, size_t bufferSize, size_t *pRead) override;
+	EStatus readNonBlocking(char *buffer, size_t bufferSize, size_t *pRead) override;
+
+	bool isReadable() override;
+
+	bool isWritable() override
+	{
+		return false;
+	}
+
+	void addReadinessWaiter() override
+	{
+		m_readinessWaiters++;
+	}
+
+	void removeReadinessWaiter() override
+	{
+		m_readinessWaiters--;
+	}
+
+	/**
+	 * @brief Zapíše data z roury přímo z jejího bufferu do jiného souboru.
+	 * Stejně jako read čeká jen na první data a potom přesune nejvýše length bajtů, které už jsou v rouře.
+	 * @param pRead Počet přesunutých bajtů, 0 znamená uzavřený zapisovací konec roury.
+	 * @param pIsDestinationError Nastaví se na true, pokud selhal zápis do cílového souboru. Může být null.
+	 */
+	EStatus readTo(IFileHandle & destination, size_t length, size_t *pRead, bool *pIsDestinationError);
 
 	EStatus write(const char *buffer, size_t bufferSize, size_t *pWritten) override
 	{
@@ -67,7 +169,7 @@ class PipeWriteEnd : public IFileHandle
 	void onReadEndClosed();
 
 	friend class PipeReadEnd;
-	friend bool Pipe::Create(HandleReference &, HandleReference &);
+	friend bool Pipe::Create(HandleReference &, HandleReference &, size_t);
 
 public:
 	PipeWriteEnd() = default;
@@ -96,4 +198,22 @@ public:
 	}
 
 	EStatus write(const char *buffer, size_t bufferSize, size_t *pWritten) override;
+
+	bool isReadable() override
+	{
+		return false;
+	}
+
+	bool isWritable() override;
+
+	void addReadinessWaiter() override;
+	void removeReadinessWaiter() override;
+
+	/**
+	 * @brief Načte data z jiného souboru přímo do bufferu roury.
+	 * Skončí po length bajtech nebo po prvním čtení, které vrátí méně dat, než bylo požadováno.
+	 * @param pIsDestinationError Nastaví se na true, pokud selhal zápis do roury, protože už nemá čtecí konec.
+	 * Může být null.
+	 */
+	EStatus writeFrom(IFileHandle & source, size_t length, size_t *pWritten, bool *pIsDestinationError);
 };
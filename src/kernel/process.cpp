@@ -6,7 +6,8 @@ HandleReference Process::getMainThread()
 	// je potřeba synchronizovat, protože m_mainThreadID se nastavuje až po vytvoření hlavního vlákna
 	std::lock_guard<std::mutex> lock(m_mutex);
 
-	return Kernel::GetHandleStorage().getHandle(m_mainThreadID);
+	// hlavní vlákno už mohlo být zrušené a jeho ID přidělené jinému handle
+	return Kernel::GetHandleStorage().getHandle(m_mainThreadID, m_mainThreadGeneration);
 }
 
 HandleReference Process::getHandle(HandleID id)
@@ -130,9 +131,14 @@ HandleReference Process::Create(const char *name, const char *cmdLine, Path && p
 		}
 
 		self.m_mainThreadID = mainThread.getID();
+		self.m_mainThreadGeneration = mainThread.getGeneration();
+
+		HandleReference threadSelf = Kernel::GetHandleStorage().getHandle(mainThread.getID(), mainThread.getGeneration());
+		HandleReference threadProcess = Kernel::GetHandleStorage().getHandle(process.getID(), process.getGeneration());
+
 		self.m_handles.insert(std::move(mainThread));
 
-		Thread::Start(entry, context, self.m_mainThreadID, process.getID());
+		Thread::Start(entry, context, std::move(threadSelf), std::move(threadProcess));
 	}
 	else
 	{
@@ -145,6 +151,7 @@ HandleReference Process::Create(const char *name, const char *cmdLine, Path && p
 		}
 
 		self.m_mainThreadID = mainThread.getID();
+		self.m_mainThreadGeneration = mainThread.getGeneration();
 		self.m_handles.insert(std::move(mainThread));
 	}
 
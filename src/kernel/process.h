@@ -15,6 +15,7 @@ class Process : public IHandle
 	std::atomic<uint16_t> m_threadCount;
 	std::atomic<bool> m_wasStarted;
 	HandleID m_mainThreadID = 0;
+	uint32_t m_mainThreadGeneration = 0;
 	Path m_currentDirectory;
 	std::string m_name;
 	std::string m_cmdLine;
@@ -1,3 +1,4 @@
+#include <cctype>
 #include <cstring>
 #include <array>
 
@@ -16,6 +17,11 @@ enum struct EProcessFile
 
 constexpr std::array<const char*, 4> PROCESS_FILE_NAMES = { "args", "cwd", "name", "threads" };
 
+// adresář se systémovými informacemi, 0:\sys\disk\<písmeno disku>\stats
+#define PROCFS_SYSTEM_DIRECTORY  "sys"
+#define PROCFS_DISK_DIRECTORY    "disk"
+#define PROCFS_DISK_STATS_FILE   "stats"
+
 static size_t CopyValue(const std::string & value, char *buffer, size_t bufferSize, uint64_t offset)
 {
 	size_t length = value.length();
@@ -140,8 +146,255 @@ static EStatus ReadProcessFile(const std::string & fileName, Process & process,
 	return EStatus::FILE_NOT_FOUND;
 }
 
+static void AppendStatistic(std::string & result, const char *prefix, const char *name, uint64_t value)
+{
+	result += prefix;
+	result += name;
+	result += ' ';
+	result += std::to_string(value);
+	result += '\n';
+}
+
+static void AppendOperationStatistics(std::string & result, const char *prefix,
+                                      const DiskStatistics::Operation & operation, uint16_t bytesPerSector)
+{
+	const uint64_t averageLatency = (operation.requests > 0) ? operation.totalLatency / operation.requests : 0;
+
+	AppendStatistic(result, prefix, "requests", operation.requests);
+	AppendStatistic(result, prefix, "sectors", operation.sectors);
+	AppendStatistic(result, prefix, "bytes", operation.sectors * bytesPerSector);
+	AppendStatistic(result, prefix, "errors", operation.errors);
+	AppendStatistic(result, prefix, "latency_avg_us", averageLatency);
+	AppendStatistic(result, prefix, "latency_max_us", operation.maxLatency);
+
+	// histogram obsahuje jen neprázdné intervaly
+	for (size_t i = 0; i < operation.latencyHistogram.size(); i++)
+	{
+		if (operation.latencyHistogram[i] == 0)
+		{
+			continue;
+		}
+
+		const uint64_t lowerBound = (i == 0) ? 0 : uint64_t(1) << i;
+
+		std::string name = "latency_us[" + std::to_string(lowerBound) + '-';
+
+		if (i + 1 < operation.latencyHistogram.size())
+		{
+			name += std::to_string(uint64_t(1) << (i + 1));
+		}
+
+		name += ')';
+
+		AppendStatistic(result, prefix, name.c_str(), operation.latencyHistogram[i]);
+	}
+}
+
+/**
+ * @brief Vytvoří obsah souboru se statistikami disku.
+ * @return False, pokud disk neexistuje, jinak true.
+ */
+static bool FormatDiskStatistics(const std::string & diskName, std::string & result)
+{
+	if (diskName.length() != 1)
+	{
+		return false;
+	}
+
+	const char diskLetter = static_cast<char>(std::toupper(static_cast<unsigned char>(diskName[0])));
+
+	const std::map<char, uint8_t> & diskNumbers = Kernel::GetFileSystem().getDiskNumbers();
+
+	auto it = diskNumbers.find(diskLetter);
+	if (it == diskNumbers.end())
+	{
+		return false;
+	}
+
+	DiskStatistics::Disk stats;
+	if (!Kernel::GetDiskStatistics().getStatistics(it->second, stats))
+	{
+		return false;
+	}
+
+	result.clear();
+
+	AppendOperationStatistics(result, "read_", stats.reads, stats.bytesPerSector);
+	AppendOperationStatistics(result, "write_", stats.writes, stats.bytesPerSector);
+
+	AppendStatistic(result, "", "queue_depth", stats.queueDepth);
+	AppendStatistic(result, "", "queue_depth_max", stats.maxQueueDepth);
+
+	AppendStatistic(result, "hal_queue_", "requests", stats.queue.requests);
+	AppendStatistic(result, "hal_queue_", "issued", stats.queue.issued);
+	AppendStatistic(result, "hal_queue_", "merged", stats.queue.merged);
+	AppendStatistic(result, "hal_queue_", "deadline_expired", stats.queue.deadline_expired);
+	AppendStatistic(result, "hal_queue_", "flushes", stats.queue.flushes);
+	AppendStatistic(result, "hal_queue_", "max_in_flight", stats.queue.max_in_flight);
+	AppendStatistic(result, "hal_queue_", "modeled_time_us", stats.queue.modeled_time_us);
+
+	AppendStatistic(result, "", "logical_bytes", stats.usage.logical_size);
+	AppendStatistic(result, "", "resident_bytes", stats.usage.resident_size);
+
+	// poslední odřádkování přidá CopyValue
+	result.pop_back();
+
+	return true;
+}
+
+/**
+ * @brief Zjistí informace o adresáři nebo souboru v 0:\sys. Komponenty cesty začínají za "sys".
+ */
+static EStatus QuerySystemFile(const Path & path, FileInfo *pInfo)
+{
+	uint16_t attributes = FileAttributes::READ_ONLY | FileAttributes::DIRECTORY;
+	uint64_t size = 0;
+
+	switch (path.getComponentCount())
+	{
+		case 1:  // 0:\sys
+		{
+			break;
+		}
+		case 2:  // 0:\sys\disk
+		{
+			if (path[1] != PROCFS_DISK_DIRECTORY)
+			{
+				return EStatus::FILE_NOT_FOUND;
+			}
+
+			break;
+		}
+		case 3:  // 0:\sys\disk\C
+		{
+			std::string content;
+			if (path[1] != PROCFS_DISK_DIRECTORY || !FormatDiskStatistics(path[2], content))
+			{
+				return EStatus::FILE_NOT_FOUND;
+			}
+
+			break;
+		}
+		case 4:  // 0:\sys\disk\C\stats
+		{
+			std::string content;
+			if (path[1] != PROCFS_DISK_DIRECTORY || path[3] != PROCFS_DISK_STATS_FILE
+			 || !FormatDiskStatistics(path[2], content))
+			{
+				return EStatus::FILE_NOT_FOUND;
+			}
+
+			attributes = FileAttributes::READ_ONLY;
+			size = content.length();
+
+			break;
+		}
+		default:
+		{
+			return EStatus::FILE_NOT_FOUND;
+		}
+	}
+
+	if (pInfo)
+	{
+		pInfo->attributes = attributes;
+		pInfo->size = size;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+static EStatus ReadSystemFile(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead)
+{
+	std::string content;
+
+	if (path.getComponentCount() != 4 || path[1] != PROCFS_DISK_DIRECTORY || path[3] != PROCFS_DISK_STATS_FILE
+	 || !FormatDiskStatistics(path[2], content))
+	{
+		return EStatus::FILE_NOT_FOUND;
+	}
+
+	const size_t length = CopyValue(content, buffer, bufferSize, offset);
+
+	if (pRead)
+	{
+		(*pRead) = length;
+	}
+
+	return EStatus::SUCCESS;
+}
+
+static EStatus ReadSystemDirectory(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset,
+                                   size_t *pRead)
+{
+	std::vector<std::string> names;
+	uint16_t attributes = FileAttributes::READ_ONLY | FileAttributes::DIRECTORY;
+
+	switch (path.getComponentCount())
+	{
+		case 1:  // 0:\sys
+		{
+			names.emplace_back(PROCFS_DISK_DIRECTORY);
+			break;
+		}
+		case 2:  // 0:\sys\disk
+		{
+			if (path[1] != PROCFS_DISK_DIRECTORY)
+			{
+				return EStatus::FILE_NOT_FOUND;
+			}
+
+			for (const auto & disk : Kernel::GetFileSystem().getDiskNumbers())
+			{
+				names.emplace_back(1, disk.first);
+			}
+
+			break;
+		}
+		case 3:  // 0:\sys\disk\C
+		{
+			std::string content;
+			if (path[1] != PROCFS_DISK_DIRECTORY || !FormatDiskStatistics(path[2], content))
+			{
+				return EStatus::FILE_NOT_FOUND;
+			}
+
+			names.emplace_back(PROCFS_DISK_STATS_FILE);
+			attributes = FileAttributes::READ_ONLY;  // soubor
+
+			break;
+		}
+		default:
+		{
+			return EStatus::FILE_NOT_FOUND;
+		}
+	}
+
+	size_t i = 0;
+	size_t pos = offset;
+	while (i < entryCount && pos < names.size())
+	{
+		Util::SetDirectoryEntry(entries[i], attributes, names[pos]);
+
+		i++;
+		pos++;
+	}
+
+	if (pRead)
+	{
+		(*pRead) = i;
+	}
+
+	return EStatus::SUCCESS;
+}
+
 EStatus ProcFS::query(const Path & path, FileInfo *pInfo)
 {
+	if (path.getComponentCount() > 0 && path[0] == PROCFS_SYSTEM_DIRECTORY)
+	{
+		return QuerySystemFile(path, pInfo);
+	}
+
 	switch (path.getComponentCount())
 	{
 		case 0:  // kořenový adresář procfs
@@ -206,8 +459,14 @@ EStatus ProcFS::query(const Path & path, FileInfo *pInfo)
 	return EStatus::SUCCESS;
 }
 
-EStatus ProcFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead)
+EStatus ProcFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+                     ExtentMap *pExtents)
 {
+	if (path.getComponentCount() > 0 && path[0] == PROCFS_SYSTEM_DIRECTORY)
+	{
+		return ReadSystemFile(path, buffer, bufferSize, offset, pRead);
+	}
+
 	if (path.getComponentCount() == 2)
 	{
 		if (path[0] == "self")
@@ -233,6 +492,11 @@ EStatus ProcFS::read(const Path & path, char *buffer, size_t bufferSize, uint64_
 
 EStatus ProcFS::readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead)
 {
+	if (path.getComponentCount() > 0 && path[0] == PROCFS_SYSTEM_DIRECTORY)
+	{
+		return ReadSystemDirectory(path, entries, entryCount, offset, pRead);
+	}
+
 	switch (path.getComponentCount())
 	{
 		case 0:
@@ -246,23 +510,26 @@ EStatus ProcFS::readDir(const Path & path, DirectoryEntry *entries, size_t entry
 
 			const uint16_t attributes = FileAttributes::READ_ONLY | FileAttributes::DIRECTORY;
 
+			// za adresáři procesů následují tyto adresáře
+			constexpr std::array<const char*, 2> otherNames = { "self", PROCFS_SYSTEM_DIRECTORY };
+
 			size_t i = 0;
 			size_t pos = offset;
-			while (i < entryCount && pos < processes.size())
+			while (i < entryCount && pos < processes.size() + otherNames.size())
 			{
-				Util::SetDirectoryEntry(entries[i], attributes, std::to_string(processes[pos].getID()));
+				if (pos < processes.size())
+				{
+					Util::SetDirectoryEntry(entries[i], attributes, std::to_string(processes[pos].getID()));
+				}
+				else
+				{
+					Util::SetDirectoryEntry(entries[i], attributes, otherNames[pos - processes.size()]);
+				}
 
 				i++;
 				pos++;
 			}
 
-			if (i < entryCount)
-			{
-				Util::SetDirectoryEntry(entries[i], attributes, "self");
-
-				i++;
-			}
-
 			if (pRead)
 			{
 				(*pRead) = i;
@@ -8,10 +8,12 @@ public:
 	ProcFS() = default;
 
 	EStatus query(const Path & path, FileInfo *pInfo) override;
-	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead) override;
+	EStatus read(const Path & path, char *buffer, size_t bufferSize, uint64_t offset, size_t *pRead,
+	             ExtentMap *pExtents) override;
 	EStatus readDir(const Path & path, DirectoryEntry *entries, size_t entryCount, size_t offset, size_t *pRead) override;
 
-	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten) override
+	EStatus write(const Path & path, const char *buffer, size_t bufferSize, uint64_t offset, size_t *pWritten,
+	              ExtentMap *pExtents) override
 	{
 		return EStatus::PERMISSION_DENIED;
 	}
@@ -30,4 +32,10 @@ public:
 	{
 		return EStatus::PERMISSION_DENIED;
 	}
+
+	EStatus flush() override
+	{
+		// nic se neukládá
+		return EStatus::SUCCESS;
+	}
 };
@@ -12,6 +12,7 @@ enum struct EStatus : uint16_t  // kiv_os::NOS_Error
 	OUT_OF_MEMORY,
 	PERMISSION_DENIED,
 	IO_ERROR,
+	WOULD_BLOCK,
 
 	UNKNOWN_ERROR = 0xFFFF
 };
@@ -1,8 +1,14 @@
+#include <algorithm>  // std::min
+#include <vector>
+
 #include "syscall.h"
 #include "kernel.h"
 #include "process.h"
 #include "pipe.h"
 
+// velikost bufferu v jádře pro přesun dat mezi soubory, které nejsou rourou
+#define SPLICE_BUFFER_SIZE  (64 * 1024)
+
 static EStatus OpenFile(Path && path, uint16_t attributes, HandleReference & result)
 {
 	const bool wantsDirectory = attributes & FileAttributes::DIRECTORY;
@@ -130,7 +136,7 @@ static EStatus Write(HandleID id, const char *buffer, uint64_t bufferSize, uint6
 	return status;
 }
 
-static EStatus Read(HandleID id, char *buffer, uint64_t bufferSize, uint64_t & result)
+static EStatus Read(HandleID id, char *buffer, uint64_t bufferSize, uint8_t flags, uint64_t & result)
 {
 	if (buffer == nullptr || bufferSize == 0)
 	{
@@ -143,8 +149,13 @@ static EStatus Read(HandleID id, char *buffer, uint64_t bufferSize, uint64_t & r
 		return EStatus::INVALID_ARGUMENT;
 	}
 
+	const bool isNonBlocking = flags & static_cast<uint8_t>(kiv_os::NRead_File::Non_Blocking);
+
+	IFileHandle *pFile = handle.as<IFileHandle>();
+
 	size_t read = 0;
-	EStatus status = handle.as<IFileHandle>()->read(buffer, static_cast<size_t>(bufferSize), &read);
+	EStatus status = (isNonBlocking) ? pFile->readNonBlocking(buffer, static_cast<size_t>(bufferSize), &read)
+	                                 : pFile->read(buffer, static_cast<size_t>(bufferSize), &read);
 
 	result = read;
 
@@ -238,13 +249,18 @@ static EStatus GetWorkingDirectory(char *buffer, uint64_t bufferSize, uint64_t &
 	return EStatus::SUCCESS;
 }
 
-static EStatus CreatePipe(HandleID *pipe)
+static EStatus CreatePipe(HandleID *pipe, uint64_t capacity)
 {
 	Process & currentProcess = Thread::GetProcess();
 
+	if (capacity > PIPE_MAX_CAPACITY)
+	{
+		capacity = PIPE_MAX_CAPACITY;
+	}
+
 	HandleReference readEnd;
 	HandleReference writeEnd;
-	if (!Pipe::Create(readEnd, writeEnd))
+	if (!Pipe::Create(readEnd, writeEnd, static_cast<size_t>(capacity)))
 	{
 		return EStatus::OUT_OF_MEMORY;
 	}
@@ -258,6 +274,115 @@ static EStatus CreatePipe(HandleID *pipe)
 	return EStatus::SUCCESS;
 }
 
+/**
+ * @brief Přesune data mezi dvěma soubory, které nejsou rourou, přes buffer v jádře.
+ * @param isDestinationError Nastaví se na true, pokud selhal zápis do cíle.
+ */
+static EStatus SpliceThroughBuffer(IFileHandle & source, IFileHandle & destination, size_t length, size_t & result,
+                                   bool & isDestinationError)
+{
+	const size_t bufferSize = std::min<size_t>(length, SPLICE_BUFFER_SIZE);
+
+	std::vector<char> buffer(bufferSize);
+
+	result = 0;
+
+	while (result < length)
+	{
+		const size_t requestedLength = std::min(length - result, bufferSize);
+
+		size_t read = 0;
+		EStatus status = source.read(buffer.data(), requestedLength, &read);
+		if (status != EStatus::SUCCESS)
+		{
+			return status;
+		}
+
+		if (read == 0)
+		{
+			break;
+		}
+
+		size_t written = 0;
+		status = destination.write(buffer.data(), read, &written);
+
+		result += written;
+
+		if (status != EStatus::SUCCESS)
+		{
+			isDestinationError = true;
+			return status;
+		}
+
+		// kratší čtení znamená konec souboru nebo zatím poslední dostupná data
+		if (written < read || read < requestedLength)
+		{
+			break;
+		}
+	}
+
+	return EStatus::SUCCESS;
+}
+
+/**
+ * @param isDestinationError Nastaví se na true, pokud selhal zápis do cíle. Jinak jde o chybu zdroje nebo argumentů.
+ */
+static EStatus Splice(HandleID sourceID, HandleID destinationID, uint64_t length, uint64_t & result,
+                      bool & isDestinationError)
+{
+	if (length == 0)
+	{
+		return EStatus::INVALID_ARGUMENT;
+	}
+
+	Process & currentProcess = Thread::GetProcess();
+
+	HandleReference source = currentProcess.getHandleOfType(sourceID, EHandle::FILE);
+	HandleReference destination = currentProcess.getHandleOfType(destinationID, EHandle::FILE);
+	if (!source || !destination)
+	{
+		return EStatus::INVALID_ARGUMENT;
+	}
+
+	IFileHandle *pSource = source.as<IFileHandle>();
+	IFileHandle *pDestination = destination.as<IFileHandle>();
+
+	if (pSource == pDestination
+	 || pSource->getFileHandleType() == EFileHandle::DIRECTORY
+	 || pDestination->getFileHandleType() == EFileHandle::DIRECTORY)
+	{
+		return EStatus::INVALID_ARGUMENT;
+	}
+
+	if (length > SIZE_MAX)
+	{
+		length = SIZE_MAX;
+	}
+
+	size_t moved = 0;
+	EStatus status;
+
+	// data z roury a do roury se kopírují přímo z jejího bufferu a do něj
+	if (pSource->getFileHandleType() == EFileHandle::PIPE_READ_END)
+	{
+		status = source.as<PipeReadEnd>()->readTo(*pDestination, static_cast<size_t>(length), &moved,
+		                                                &isDestinationError);
+	}
+	else if (pDestination->getFileHandleType() == EFileHandle::PIPE_WRITE_END)
+	{
+		status = destination.as<PipeWriteEnd>()->writeFrom(*pSource, static_cast<size_t>(length), &moved,
+		                                                          &isDestinationError);
+	}
+	else
+	{
+		status = SpliceThroughBuffer(*pSource, *pDestination, static_cast<size_t>(length), moved, isDestinationError);
+	}
+
+	result = moved;
+
+	return status;
+}
+
 EStatus SysCall::HandleIO(kiv_hal::TRegisters & context)
 {
 	switch (static_cast<kiv_os::NOS_File_System>(context.rax.l))
@@ -272,7 +397,7 @@ EStatus SysCall::HandleIO(kiv_hal::TRegisters & context)
 		}
 		case kiv_os::NOS_File_System::Read_File:
 		{
-			return Read(context.rdx.x, reinterpret_cast<char*>(context.rdi.r), context.rcx.r, context.rax.r);
+			return Read(context.rdx.x, reinterpret_cast<char*>(context.rdi.r), context.rcx.r, context.rbx.l, context.rax.r);
 		}
 		case kiv_os::NOS_File_System::Seek:
 		{
@@ -296,7 +421,18 @@ EStatus SysCall::HandleIO(kiv_hal::TRegisters & context)
 		}
 		case kiv_os::NOS_File_System::Create_Pipe:
 		{
-			return CreatePipe(reinterpret_cast<HandleID*>(context.rdx.r));
+			return CreatePipe(reinterpret_cast<HandleID*>(context.rdx.r), context.rcx.r);
+		}
+		case kiv_os::NOS_File_System::Splice:
+		{
+			bool isDestinationError = false;
+			const EStatus status = Splice(context.rdx.x, context.rbx.x, context.rcx.r, context.rax.r, isDestinationError);
+			if (status != EStatus::SUCCESS)
+			{
+				context.rcx.l = (isDestinationError) ? 1 : 0;
+			}
+
+			return status;
 		}
 	}
 
@@ -104,14 +104,26 @@ static EStatus Clone(const kiv_hal::TRegisters & context, HandleID & result)
 	return EStatus::INVALID_ARGUMENT;
 }
 
-static EStatus WaitFor(const HandleID *handles, uint16_t handleCount, uint16_t & result)
+static EStatus WaitFor(const HandleID *handles, uint16_t handleCount, uint8_t fileEvents, uint16_t & result)
 {
 	if (handles == nullptr || handleCount == 0)
 	{
 		return EStatus::INVALID_ARGUMENT;
 	}
 
-	return Kernel::GetEventSystem().waitForMultiple(handles, handleCount, Event::THREAD_END | Event::PROCESS_END, result);
+	int events = Event::THREAD_END | Event::PROCESS_END;
+
+	if (fileEvents & static_cast<uint8_t>(kiv_os::NWait_For_File::Readable))
+	{
+		events |= Event::FILE_READABLE;
+	}
+
+	if (fileEvents & static_cast<uint8_t>(kiv_os::NWait_For_File::Writable))
+	{
+		events |= Event::FILE_WRITABLE;
+	}
+
+	return Kernel::GetEventSystem().waitForMultiple(handles, handleCount, events, result);
 }
 
 static EStatus GetExitCode(HandleID id, uint16_t & exitCode)
@@ -221,7 +233,7 @@ EStatus SysCall::HandleProcess(kiv_hal::TRegisters & context)
 		}
 		case kiv_os::NOS_Process::Wait_For:
 		{
-			return WaitFor(reinterpret_cast<HandleID*>(context.rdx.r), context.rcx.x, context.rax.x);
+			return WaitFor(reinterpret_cast<HandleID*>(context.rdx.r), context.rcx.x, context.rbx.l, context.rax.x);
 		}
 		case kiv_os::NOS_Process::Read_Exit_Code:
 		{
@@ -15,12 +15,12 @@ static thread_local ThreadEnvironment *g_pThreadEnv;
 
 struct ThreadEnvironmentGuard
 {
-	ThreadEnvironmentGuard(HandleID threadID, HandleID processID)
+	ThreadEnvironmentGuard(HandleReference && self, HandleReference && process)
 	{
 		g_pThreadEnv = new ThreadEnvironment;
 
-		g_pThreadEnv->self    = Kernel::GetHandleStorage().getHandle(threadID);
-		g_pThreadEnv->process = Kernel::GetHandleStorage().getHandle(processID);
+		g_pThreadEnv->self    = std::move(self);
+		g_pThreadEnv->process = std::move(process);
 	}
 
 	~ThreadEnvironmentGuard()
@@ -30,9 +30,13 @@ struct ThreadEnvironmentGuard
 	}
 };
 
-void Thread::Start(TEntryFunc entry, kiv_hal::TRegisters context, HandleID threadID, HandleID processID)
+void Thread::Start(TEntryFunc entry, kiv_hal::TRegisters context, HandleReference threadHandle,
+                   HandleReference processHandle)
 {
-	ThreadEnvironmentGuard environment(threadID, processID);
+	const HandleID threadID = threadHandle.getID();
+	const HandleID processID = processHandle.getID();
+
+	ThreadEnvironmentGuard environment(std::move(threadHandle), std::move(processHandle));
 
 	Thread & self = Thread::Get();
 	Process & process = Thread::GetProcess();
@@ -79,7 +83,12 @@ HandleReference Thread::Create(TEntryFunc entry, const kiv_hal::TRegisters & con
 		return HandleReference();
 	}
 
-	std::thread thread(Start, entry, context, threadHandle.getID(), processID);
+	// nové vlákno dostane vlastní reference, protože volající může svou referenci na vlákno uvolnit ještě před jeho
+	// spuštěním a ID vlákna pak může patřit jinému handle
+	HandleReference self = Kernel::GetHandleStorage().getHandle(threadHandle.getID(), threadHandle.getGeneration());
+	HandleReference process = Kernel::GetHandleStorage().getHandle(processID);  // proces volajícího existuje
+
+	std::thread thread(Start, entry, context, std::move(self), std::move(process));
 
 	thread.detach();
 
@@ -30,8 +30,9 @@ class Thread : public IHandle
 		m_wasStarted.store(wasStarted, std::memory_order_relaxed);
 	}
 
-	// vstupní bod vlákna
-	static void Start(TEntryFunc entry, kiv_hal::TRegisters context, HandleID threadID, HandleID processID);
+	// vstupní bod vlákna, reference na vlákno a proces drží vlákno po celou dobu běhu
+	static void Start(TEntryFunc entry, kiv_hal::TRegisters context, HandleReference threadHandle,
+	                  HandleReference processHandle);
 
 	friend class Process;
 
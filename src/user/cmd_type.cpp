@@ -16,24 +16,26 @@ static bool PrintFile(const std::string & name)
 		return false;
 	}
 
-	char buffer[4096];
+	// data se přesouvají na výstup přímo v jádře, takže nemusí procházet bufferem procesu
+	const size_t blockSize = 64 * 1024;
 	size_t length;
 
 	do
 	{
 		length = 0;
-		if (!file.read(buffer, sizeof buffer, &length))
+		bool isOutputError = false;
+		if (!RTL::Splice(file.handle, RTL::GetStdOutHandle(), blockSize, &length, &isOutputError))
 		{
-			ShowFileError(name);
-			return false;
-		}
+			// chyba výstupu, např. roura, kterou už nikdo nečte, se stejně jako dřív ignoruje
+			if (!isOutputError)
+			{
+				ShowFileError(name);
+			}
 
-		if (length > 0)
-		{
-			RTL::WriteStdOut(buffer, length);
+			return false;
 		}
 	}
-	while (length == sizeof buffer);
+	while (length == blockSize);
 
 	return true;
 }
@@ -213,13 +213,14 @@ RTL::Handle RTL::CreateThread(RTL::ThreadMain mainFunc, void *param)
 	return registers.rax.x;
 }
 
-int RTL::WaitForMultiple(const RTL::Handle *handles, uint16_t count)
+int RTL::WaitForMultiple(const RTL::Handle *handles, uint16_t count, int fileEvents)
 {
 	kiv_hal::TRegisters registers;
 	registers.rax.h = static_cast<uint8_t>(kiv_os::NOS_Service_Major::Process);
 	registers.rax.l = static_cast<uint8_t>(kiv_os::NOS_Process::Wait_For);
 	registers.rdx.r = reinterpret_cast<uint64_t>(handles);
 	registers.rcx.x = count;
+	registers.rbx.l = static_cast<uint8_t>(fileEvents);
 
 	if (!SysCall(registers))
 	{
@@ -362,6 +363,7 @@ std::string RTL::ErrorToString(RTL::Error error)
 		case RTL::Error::OUT_OF_MEMORY:         return "Nedostatek pameti";
 		case RTL::Error::PERMISSION_DENIED:     return "Pristup odepren";
 		case RTL::Error::IO_ERROR:              return "Chyba IO";
+		case RTL::Error::WOULD_BLOCK:           return "Operace by blokovala";
 		case RTL::Error::UNKNOWN_ERROR:         break;
 	}
 
@@ -456,6 +458,30 @@ bool RTL::ReadFile(kiv_os::THandle file, void *buffer, size_t size, size_t *pRea
 	registers.rdx.x = file;
 	registers.rdi.r = reinterpret_cast<uint64_t>(buffer);
 	registers.rcx.r = size;
+	registers.rbx.l = 0;
+
+	if (!SysCall(registers))
+	{
+		return false;
+	}
+
+	if (pRead)
+	{
+		(*pRead) = static_cast<size_t>(registers.rax.r);
+	}
+
+	return true;
+}
+
+bool RTL::ReadFileNonBlocking(kiv_os::THandle file, void *buffer, size_t size, size_t *pRead)
+{
+	kiv_hal::TRegisters registers;
+	registers.rax.h = static_cast<uint8_t>(kiv_os::NOS_Service_Major::File_System);
+	registers.rax.l = static_cast<uint8_t>(kiv_os::NOS_File_System::Read_File);
+	registers.rdx.x = file;
+	registers.rdi.r = reinterpret_cast<uint64_t>(buffer);
+	registers.rcx.r = size;
+	registers.rbx.l = static_cast<uint8_t>(kiv_os::NRead_File::Non_Blocking);
 
 	if (!SysCall(registers))
 	{
@@ -492,6 +518,34 @@ bool RTL::WriteFile(kiv_os::THandle file, const void *buffer, size_t size, size_
 	return true;
 }
 
+bool RTL::Splice(kiv_os::THandle source, kiv_os::THandle destination, size_t size, size_t *pMoved,
+                 bool *pIsDestinationError)
+{
+	kiv_hal::TRegisters registers;
+	registers.rax.h = static_cast<uint8_t>(kiv_os::NOS_Service_Major::File_System);
+	registers.rax.l = static_cast<uint8_t>(kiv_os::NOS_File_System::Splice);
+	registers.rdx.x = source;
+	registers.rbx.x = destination;
+	registers.rcx.r = size;
+
+	if (!SysCall(registers))
+	{
+		if (pIsDestinationError)
+		{
+			(*pIsDestinationError) = (registers.rcx.l != 0);
+		}
+
+		return false;
+	}
+
+	if (pMoved)
+	{
+		(*pMoved) = static_cast<size_t>(registers.rax.r);
+	}
+
+	return true;
+}
+
 bool RTL::WriteFileFormatV(RTL::Handle file, size_t *pWritten, const char *format, va_list args)
 {
 	StringBuffer<4096> buffer;
@@ -575,7 +629,7 @@ bool RTL::DeleteDirectory(const char *path, bool recursively)
 // ==  Ostatní  ==
 // ===============
 
-RTL::Pipe RTL::CreatePipe()
+RTL::Pipe RTL::CreatePipe(size_t capacity)
 {
 	kiv_os::THandle handles[2] = { 0, 0 };
 
@@ -583,6 +637,7 @@ RTL::Pipe RTL::CreatePipe()
 	registers.rax.h = static_cast<uint8_t>(kiv_os::NOS_Service_Major::File_System);
 	registers.rax.l = static_cast<uint8_t>(kiv_os::NOS_File_System::Create_Pipe);
 	registers.rdx.r = reinterpret_cast<uint64_t>(handles);
+	registers.rcx.r = capacity;
 
 	if (!SysCall(registers))
 	{
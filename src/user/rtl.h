@@ -36,6 +36,7 @@ namespace RTL
 		OUT_OF_MEMORY,
 		PERMISSION_DENIED,
 		IO_ERROR,
+		WOULD_BLOCK,
 
 		UNKNOWN_ERROR = 0xFFFF
 	};
@@ -64,6 +65,15 @@ namespace RTL
 		};
 	}
 
+	namespace FileEvents  // kiv_os::NWait_For_File
+	{
+		enum
+		{
+			READABLE = (1 << 0),  // čtení nebude blokovat, v rouře jsou data nebo je uzavřený její zapisovací konec
+			WRITABLE = (1 << 1)   // zápis nebude blokovat, v rouře je volné místo nebo je uzavřený její čtecí konec
+		};
+	}
+
 	using ThreadMain = int (*)(void *param);
 	using SignalHandler = void (*)(Signal signal);
 
@@ -126,17 +136,20 @@ namespace RTL
 	Handle CreateThread(ThreadMain mainFunc, void *param);
 
 	/**
-	 * @brief Blokuje, dokud se některý ze zadaných procesů nebo vláken neukončí.
-	 * @param handles Pole obsahující handle procesů nebo vláken, na které se má čekat.
-	 * @param count Celkový počet procesů nebo vláken, na které se má čekat.
-	 * @return Index handle procesu nebo vlákna, který je ukončený nebo se ukončil během čekání. Pokud došlo k chybě, tak -1.
+	 * @brief Blokuje, dokud se některý ze zadaných procesů nebo vláken neukončí nebo dokud není některý ze zadaných souborů
+	 * nebo rour připravený.
+	 * @param handles Pole obsahující handle procesů, vláken, souborů nebo rour, na které se má čekat.
+	 * @param count Celkový počet handle, na které se má čekat.
+	 * @param fileEvents Na jakou připravenost souborů a rour se čeká, viz RTL::FileEvents. Bez nich lze čekat jen na procesy
+	 * a vlákna.
+	 * @return Index handle, který je signalizovaný nebo se stal signalizovaným během čekání. Pokud došlo k chybě, tak -1.
 	 * Chybový kód je možné získat pomocí RTL::GetLastError.
 	 */
-	int WaitForMultiple(const Handle *handles, uint16_t count);
+	int WaitForMultiple(const Handle *handles, uint16_t count, int fileEvents = 0);
 
-	inline int WaitForMultiple(const std::vector<Handle> & handles)
+	inline int WaitForMultiple(const std::vector<Handle> & handles, int fileEvents = 0)
 	{
-		return WaitForMultiple(handles.data(), static_cast<uint16_t>(handles.size()));
+		return WaitForMultiple(handles.data(), static_cast<uint16_t>(handles.size()), fileEvents);
 	}
 
 	inline bool WaitForSingle(Handle handle)
@@ -546,6 +559,19 @@ namespace RTL
 	 */
 	bool ReadFile(Handle file, void *buffer, size_t size, size_t *pRead = nullptr);
 
+	/**
+	 * @brief Načte data ze souboru bez blokování.
+	 * Pokud v rouře nebo na konzoli zatím nejsou žádná data, vrátí false s chybovým kódem Error::WOULD_BLOCK. Na data je
+	 * pak možné počkat pomocí RTL::WaitForMultiple s RTL::FileEvents::READABLE.
+	 * @param file Deskriptor souboru.
+	 * @param buffer Buffer pro uložení načtených dat.
+	 * @param size Velikost bufferu pro uložení načtených dat v bajtech.
+	 * @param pRead Volitelný ukazatel na proměnnou, kam se uloží počet načtených bajtů. Nula znamená konec dat. Může být
+	 * null.
+	 * @return Pokud vše proběhlo v pořádku, tak true, jinak false. Chybový kód je možné získat pomocí RTL::GetLastError.
+	 */
+	bool ReadFileNonBlocking(Handle file, void *buffer, size_t size, size_t *pRead = nullptr);
+
 	/**
 	 * @brief Načte data ze standardního vstupu procesu.
 	 * @param buffer Buffer pro uložení načtených dat.
@@ -598,6 +624,21 @@ namespace RTL
 		return WriteFile(file, buffer.get(), buffer.getLength(), pWritten);
 	}
 
+	/**
+	 * @brief Přesune data z jednoho souboru do druhého uvnitř jádra bez kopírování přes buffer procesu.
+	 * Funguje pro soubory i roury. Přesun skončí dříve, pokud zdroj vrátí méně dat, než bylo požadováno.
+	 * @param source Deskriptor zdrojového souboru.
+	 * @param destination Deskriptor cílového souboru.
+	 * @param size Nejvyšší počet bajtů k přesunutí.
+	 * @param pMoved Volitelný ukazatel na proměnnou, kam se uloží počet přesunutých bajtů. Nula znamená konec zdroje.
+	 * Může být null.
+	 * @param pIsDestinationError Volitelný ukazatel na proměnnou, kam se při chybě uloží, jestli selhal zápis do cíle.
+	 * Jinak jde o chybu zdroje nebo neplatné argumenty. Může být null.
+	 * @return Pokud vše proběhlo v pořádku, tak true, jinak false. Chybový kód je možné získat pomocí RTL::GetLastError.
+	 */
+	bool Splice(Handle source, Handle destination, size_t size, size_t *pMoved = nullptr,
+	            bool *pIsDestinationError = nullptr);
+
 	bool WriteFileFormatV(Handle file, size_t *pWritten, const char *format, va_list args);
 
 	inline bool WriteFileFormatV(Handle file, const char *format, va_list args)
@@ -1084,10 +1125,11 @@ namespace RTL
 
 	/**
 	 * @brief Vytvoří jednosměrnou rouru.
+	 * @param capacity Kapacita roury v bajtech. Nula znamená výchozí kapacitu.
 	 * @return Otevřenou rouru nebo uzavřenou rouru, pokud se rouru nepodařilo vytvořit. Chybový kód je možné získat pomocí
 	 * RTL::GetLastError.
 	 */
-	Pipe CreatePipe();
+	Pipe CreatePipe(size_t capacity = 0);
 
 	/**
 	 * @brief Provede řádné ukončení celého systému.